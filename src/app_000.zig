@@ -11,14 +11,16 @@ const M33 = math.M33;
 const OBJ = @import("obj.zig");
 const TGA = @import("tga.zig");
 const Buffer2D = @import("buffer.zig").Buffer2D;
+const MipChain = @import("buffer.zig").MipChain;
 const RGBA = @import("pixels.zig").RGBA;
 const RGB = @import("pixels.zig").RGB;
 const BGRA = @import("pixels.zig").BGRA;
 
-const GouraudShader = @import("shaders/gouraud.zig").Shader(platform.OutPixelType, RGB);
+const GouraudShader = @import("shaders/gouraud.zig").MipMappedShader(platform.OutPixelType, RGB);
 const QuadShaderRgb = @import("shaders/quad.zig").Shader(platform.OutPixelType, RGB, false, false);
 const QuadShaderRgba = @import("shaders/quad.zig").Shader(platform.OutPixelType, RGBA, false, false);
 const TextRenderer = @import("text.zig").TextRenderer(platform.OutPixelType, 1024, 1);
+const DrawCommandList = @import("graphics.zig").DrawCommandList(platform.OutPixelType);
 
 const windows = @import("windows.zig");
 const wasm = @import("wasm.zig");
@@ -55,7 +57,9 @@ const Camera = struct {
 const State = struct {
     depth_buffer: Buffer2D(f32),
     texture: Buffer2D(RGB),
+    texture_mip_chain: MipChain(RGB),
     vertex_buffer: std.ArrayList(GouraudShader.Vertex),
+    draw_commands: DrawCommandList,
     camera: Camera,
     time: f64,
     temp_fba: std.heap.FixedBufferAllocator,
@@ -69,6 +73,7 @@ pub fn init(allocator: std.mem.Allocator) anyerror!void {
     defer state.temp_fba.reset();
 
     state.depth_buffer = Buffer2D(f32).from(try allocator.alloc(f32, Application.height*Application.width), @intCast(Application.width));
+    state.draw_commands = DrawCommandList.init(allocator);
     state.camera.position = Vector3f { .x = 0, .y = 0, .z = 0 };
     state.camera.up = Vector3f { .x = 0, .y = 1, .z = 0 };
     state.camera.direction = Vector3f { .x = 0, .y = 0, .z = 1 };
@@ -78,6 +83,7 @@ pub fn init(allocator: std.mem.Allocator) anyerror!void {
         const bytes = try Application.read_file_sync(state.temp_fba.allocator(), "res/african_head_diffuse.tga");
         defer state.temp_fba.reset();
         state.texture = try TGA.from_bytes(RGB, allocator, bytes);
+        state.texture_mip_chain = try MipChain(RGB).init(allocator, state.texture, .box);
     }
     // load the head model .obj
     {
@@ -135,13 +141,17 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
     const projection_matrix = M44.perspective_projection(60, aspect_ratio, 0.1, 255);
     const viewport_matrix = M44.viewport(0, 0, w, h, 255);
 
+    // the 3d draws are only recorded and then executed sorted on `flush`, so whatever they reference has to outlive the blocks below
+    var rgb_quad_vertex_buffer: [4]QuadShaderRgb.Vertex = undefined;
+    var rgba_quad_vertex_buffer: [4]QuadShaderRgba.Vertex = undefined;
+
     // Example rendering OBJ model with Gouraud Shading
     if (true) {
         const horizontally_spinning_position = Vector3f { .x = std.math.cos(@as(f32, @floatCast(state.time)) / 2000), .y = 0, .z = 4 + std.math.sin(@as(f32, @floatCast(state.time)) / 2000) };
         const render_context = GouraudShader.Context {
             .light_position_camera_space = view_matrix.apply_to_vec3(horizontally_spinning_position).perspective_division(),
             .projection_matrix = projection_matrix,
-            .texture = state.texture,
+            .texture = state.texture_mip_chain,
             .texture_height = state.texture.height,
             .texture_width = state.texture.width,
             .view_model_matrix = view_matrix.multiply(
@@ -152,7 +162,10 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
             .depth_buffer = state.depth_buffer,
             .viewport_matrix = viewport_matrix,
         };
-        GouraudShader.Pipeline.render(ud.pixel_buffer, render_context, state.vertex_buffer.items, @divExact(state.vertex_buffer.items.len, 3), render_requirements);
+        state.draw_commands.record(GouraudShader.Pipeline, render_context, state.vertex_buffer.items, @divExact(state.vertex_buffer.items.len, 3), render_requirements, .{
+            .center = view_matrix.apply_to_vec3(Vector3f { .x = 0, .y = 0, .z = 4 }).perspective_division(),
+            .radius = 0.87,
+        });
     }
 
     // render the model texture as a quad
@@ -169,7 +182,7 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
                     )
                 ),
         };
-        const vertex_buffer = [_]QuadShaderRgb.Vertex{
+        rgb_quad_vertex_buffer = [_]QuadShaderRgb.Vertex{
             .{ .pos = .{.x=0,.y=0}, .uv = .{.x=0,.y=0} },
             .{ .pos = .{.x=tw,.y=0}, .uv = .{.x=1,.y=0} },
             .{ .pos = .{.x=tw,.y=th}, .uv = .{.x=1,.y=1} },
@@ -181,7 +194,11 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
             .viewport_matrix = viewport_matrix,
             .index_buffer = &index_buffer,
         };
-        QuadShaderRgb.Pipeline.render(ud.pixel_buffer, quad_context, &vertex_buffer, index_buffer.len/3, requirements);
+        state.draw_commands.record(QuadShaderRgb.Pipeline, quad_context, @as([]const QuadShaderRgb.Vertex, &rgb_quad_vertex_buffer), index_buffer.len/3, requirements, .{
+            .center = view_matrix.apply_to_vec3(Vector3f { .x = 0, .y = 0, .z = 1.5 }).perspective_division(),
+            .radius = 0.71,
+            .translucent = true,
+        });
     }
     
     // render the font texture as a quad
@@ -198,7 +215,7 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
                     )
                 ),
         };
-        const vertex_buffer = [_]QuadShaderRgba.Vertex{
+        rgba_quad_vertex_buffer = [_]QuadShaderRgba.Vertex{
             .{ .pos = .{.x=0,.y=0}, .uv = .{.x=0,.y=0} },
             .{ .pos = .{.x=tw,.y=0}, .uv = .{.x=1,.y=0} },
             .{ .pos = .{.x=tw,.y=th}, .uv = .{.x=1,.y=1} },
@@ -210,9 +227,15 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
             .viewport_matrix = viewport_matrix,
             .index_buffer = &index_buffer,
         };
-        QuadShaderRgba.Pipeline.render(ud.pixel_buffer, quad_context, &vertex_buffer, index_buffer.len/3, requirements);
+        state.draw_commands.record(QuadShaderRgba.Pipeline, quad_context, @as([]const QuadShaderRgba.Vertex, &rgba_quad_vertex_buffer), index_buffer.len/3, requirements, .{
+            .center = view_matrix.apply_to_vec3(Vector3f { .x = 0, .y = 0, .z = 1 }).perspective_division(),
+            .radius = 0.71,
+            .translucent = true,
+        });
     }
 
+    state.draw_commands.flush(ud.pixel_buffer);
+
     const debug_color = RGBA.from(RGBA, @bitCast(@as(u32, 0xffffffff)));
     var text_renderer = try TextRenderer.init(ud.allocator);
     const text_height = text_renderer.height() + 1;
@@ -16,6 +16,7 @@ const Buffer2D = @import("buffer.zig").Buffer2D;
 const RGB = @import("pixels.zig").RGB;
 const RGBA = @import("pixels.zig").RGBA;
 const BGR = @import("pixels.zig").BGR;
+const Indexed = @import("pixels.zig").Indexed;
 
 const windows = @import("windows.zig");
 const wasm = @import("wasm.zig");
@@ -47,6 +48,7 @@ const text_scale = 1;
 const State = struct {
     resources: Resources,
     resource_file_name: []const u8,
+    renderer: Renderer(platform.OutPixelType),
     long_term_allocator: std.mem.Allocator = undefined
 };
 
@@ -56,6 +58,7 @@ pub fn init(allocator: std.mem.Allocator) anyerror!void {
     state.resource_file_name = "res/resources.bin";
     state.resources = try Resources.init(allocator);
     state.long_term_allocator = allocator;
+    state.renderer = try Renderer(platform.OutPixelType).init(allocator);
     const bytes = try Application.read_file_sync(allocator, state.resource_file_name);
     defer allocator.free(bytes);
     try state.resources.load_from_bytes(bytes);
@@ -68,7 +71,7 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
     const h: f32 = @floatFromInt(ud.pixel_buffer.height);
     const w: f32 = @floatFromInt(ud.pixel_buffer.width);
 
-    var renderer = try Renderer(platform.OutPixelType).init(ud.allocator);
+    const renderer = &state.renderer;
     
     const viewport_matrix = M33.viewport(0, 0, w, h);
     const projection_matrix_screen = M33.orthographic_projection(0, w, h, 0);
@@ -778,10 +781,9 @@ fn Container(comptime id: []const u8) type {
                 column_bb = total_bb;
 
                 pos = _pos;
+                renderer = try Renderer(platform.OutPixelType).init(allocator);
             }
             
-            renderer = try Renderer(platform.OutPixelType).init(allocator);
-            
             // reset the data for a new frame
             
             total_bb = BoundingBox(f32).from(pos.y, pos.y, pos.x, @max(pos.x + total_bb.width(), (1+char_width)*@as(f32,@floatFromInt(name.len))));
@@ -793,10 +795,8 @@ fn Container(comptime id: []const u8) type {
             mouse_down = _mouse_down;
             renderer.set_context(pixel_buffer, mvp_matrix, viewport_matrix);
 
-            // NOTE this is a hack until I have layers in the renderer. Since I dont know the full size of the container yet
-            // once I know it later on the call to `end()` I will then alter these values here for the correct ones.
-            // TODO fix this hack
-            try renderer.add_quad_from_bb(BoundingBox(f32).from(1,0,0,1), background_color);
+            // the background goes in layer 0 on `end()`, once the full size of the container is known
+            renderer.set_layer(1, .submission_order);
 
             var header_bb = BoundingBox(f32).from(total_bb.top, total_bb.top - text_line_height, total_bb.left, total_bb.right);
             total_bb.bottom = header_bb.bottom;
@@ -1053,14 +1053,9 @@ fn Container(comptime id: []const u8) type {
         }
 
         fn end() !void {
-            // TODO render in background layer
-            // For now this is a huge hack lol dont do this
-            try renderer.batches_shapes.items[0].add_quad_from_bb(total_bb, background_color);
-            renderer.batches_shapes.items[0].vertex_buffer.items[3] = renderer.batches_shapes.items[0].vertex_buffer.pop();
-            renderer.batches_shapes.items[0].vertex_buffer.items[2] = renderer.batches_shapes.items[0].vertex_buffer.pop();
-            renderer.batches_shapes.items[0].vertex_buffer.items[1] = renderer.batches_shapes.items[0].vertex_buffer.pop();
-            renderer.batches_shapes.items[0].vertex_buffer.items[0] = renderer.batches_shapes.items[0].vertex_buffer.pop();
-            
+            renderer.set_layer(0, .submission_order);
+            try renderer.add_quad_from_bb(total_bb, background_color);
+            renderer.set_layer(1, .submission_order);
             try renderer.add_quad_border(total_bb, 1, highlight_color_a);
         }
 
@@ -1108,7 +1103,8 @@ pub fn ShapeRenderer(comptime output_pixel_type: type, comptime color: RGB) type
                 .blend_with_background = true,
                 .do_quad_clipping = true,
                 .do_scissoring = false,
-                .trace = false
+                .trace = false,
+                .flat_quads = true,
             };
 
             pub const Pipeline = graphics.GraphicsPipelineQuads2D(
@@ -1240,12 +1236,21 @@ pub fn ShapeRenderer(comptime output_pixel_type: type, comptime color: RGB) type
                 try self.vertex_buffer.appendSlice(&vertices);
             }
 
-            pub fn flush(self: *Batch) void {
+            /// renders the quads in `vertex_buffer.items[first_vertex..first_vertex+vertex_count]`, keeping the vertices
+            pub fn render_range(self: *Batch, first_vertex: usize, vertex_count: usize) void {
                 const context = shader.Context {
                     .mvp_matrix = self.mvp_matrix,
                 };
-                shader.Pipeline.render(self.pixel_buffer, context, self.vertex_buffer.items, @divExact(self.vertex_buffer.items.len, 4), .{ .viewport_matrix = self.viewport_matrix, });
-                self.vertex_buffer.clearAndFree();
+                shader.Pipeline.render(self.pixel_buffer, context, self.vertex_buffer.items[first_vertex..][0..vertex_count], @divExact(vertex_count, 4), .{ .viewport_matrix = self.viewport_matrix, });
+            }
+
+            pub fn flush(self: *Batch) void {
+                self.render_range(0, self.vertex_buffer.items.len);
+                self.vertex_buffer.clearRetainingCapacity();
+            }
+
+            fn deinit(self: *Batch) void {
+                self.vertex_buffer.deinit();
             }
         };
     
@@ -1276,6 +1281,7 @@ pub fn StandardQuadRenderer(comptime output_pixel_type: type, comptime texture_p
                 .do_quad_clipping = true,
                 .do_scissoring = false,
                 .trace = false,
+                .blit = .{ .uv_field = "uv", .texture_field = if (output_pixel_type == texture_pixel_type) "texture" else null },
             };
 
             pub const Pipeline = graphics.GraphicsPipelineQuads2D(
@@ -1292,7 +1298,7 @@ pub fn StandardQuadRenderer(comptime output_pixel_type: type, comptime texture_p
                 }.vertex_shader,
                 struct {
                     inline fn fragment_shader(context: Context, invariants: Invariant) output_pixel_type {
-                        const sample = context.texture.point_sample(true, invariants.uv);
+                        const sample = context.texture.point_sample(false, invariants.uv);
                         return output_pixel_type.from(texture_pixel_type, sample);
                     }
                 }.fragment_shader,
@@ -1317,9 +1323,9 @@ pub fn StandardQuadRenderer(comptime output_pixel_type: type, comptime texture_p
             self.texture = texture;
             const vertex_buffer = [4] shader.Vertex {
                 .{ .pos = bb.bl(), .uv = Vec2(f32).from(0, 0) }, // 0 - bottom left
-                .{ .pos = bb.br(), .uv = Vec2(f32).from(1, 0) }, // 1 - bottom right
-                .{ .pos = bb.tr(), .uv = Vec2(f32).from(1, 1) }, // 2 - top right
-                .{ .pos = bb.tl(), .uv = Vec2(f32).from(0, 1) }, // 3 - top left
+                .{ .pos = bb.br(), .uv = Vec2(f32).from(@floatFromInt(texture.width), 0) }, // 1 - bottom right
+                .{ .pos = bb.tr(), .uv = Vec2(f32).from(@floatFromInt(texture.width), @floatFromInt(texture.height)) }, // 2 - top right
+                .{ .pos = bb.tl(), .uv = Vec2(f32).from(0, @floatFromInt(texture.height)) }, // 3 - top left
             };
             try self.vertex_buffer.appendSlice(&vertex_buffer);
         }
@@ -1354,23 +1360,43 @@ pub fn StandardQuadRenderer(comptime output_pixel_type: type, comptime texture_p
                 };
             }
 
+            /// `region` is in texels of the texture
+            pub fn add_blit_texture_region_to_bb(self: *Batch, bb: BoundingBox(f32), region: BoundingBox(f32)) !void {
+                const vertex_buffer = [4] shader.Vertex {
+                    .{ .pos = bb.bl(), .uv = region.bl() }, // 0 - bottom left
+                    .{ .pos = bb.br(), .uv = region.br() }, // 1 - bottom right
+                    .{ .pos = bb.tr(), .uv = region.tr() }, // 2 - top right
+                    .{ .pos = bb.tl(), .uv = region.tl() }, // 3 - top left
+                };
+                try self.vertex_buffer.appendSlice(&vertex_buffer);
+            }
+
             pub fn add_blit_texture_to_bb(self: *Batch, bb: BoundingBox(f32)) !void {
                 const vertex_buffer = [4] shader.Vertex {
                     .{ .pos = bb.bl(), .uv = Vec2(f32).from(0, 0) }, // 0 - bottom left
-                    .{ .pos = bb.br(), .uv = Vec2(f32).from(1, 0) }, // 1 - bottom right
-                    .{ .pos = bb.tr(), .uv = Vec2(f32).from(1, 1) }, // 2 - top right
-                    .{ .pos = bb.tl(), .uv = Vec2(f32).from(0, 1) }, // 3 - top left
+                    .{ .pos = bb.br(), .uv = Vec2(f32).from(@floatFromInt(self.texture.width), 0) }, // 1 - bottom right
+                    .{ .pos = bb.tr(), .uv = Vec2(f32).from(@floatFromInt(self.texture.width), @floatFromInt(self.texture.height)) }, // 2 - top right
+                    .{ .pos = bb.tl(), .uv = Vec2(f32).from(0, @floatFromInt(self.texture.height)) }, // 3 - top left
                 };
                 try self.vertex_buffer.appendSlice(&vertex_buffer);
             }
 
-            pub fn flush(self: *Batch) void {
+            /// renders the quads in `vertex_buffer.items[first_vertex..first_vertex+vertex_count]`, keeping the vertices
+            pub fn render_range(self: *Batch, first_vertex: usize, vertex_count: usize) void {
                 const context = shader.Context {
                     .texture = self.texture,
                     .mvp_matrix = self.mvp_matrix,
                 };
-                shader.Pipeline.render(self.pixel_buffer, context, self.vertex_buffer.items, @divExact(self.vertex_buffer.items.len, 4), .{ .viewport_matrix = self.viewport_matrix, });
-                self.vertex_buffer.clearAndFree();
+                shader.Pipeline.render(self.pixel_buffer, context, self.vertex_buffer.items[first_vertex..][0..vertex_count], @divExact(vertex_count, 4), .{ .viewport_matrix = self.viewport_matrix, });
+            }
+
+            pub fn flush(self: *Batch) void {
+                self.render_range(0, self.vertex_buffer.items.len);
+                self.vertex_buffer.clearRetainingCapacity();
+            }
+
+            fn deinit(self: *Batch) void {
+                self.vertex_buffer.deinit();
             }
         };
     };
@@ -1571,21 +1597,32 @@ pub fn TextRenderer(comptime out_pixel_type: type, comptime max_size_per_print:
                 }
             }
 
-            pub fn flush(self: *Batch) void {
+            /// renders the quads in `vertex_buffer.items[first_vertex..first_vertex+vertex_count]`, keeping the vertices
+            pub fn render_range(self: *Batch, first_vertex: usize, vertex_count: usize) void {
                 Shader.Pipeline.render(
                     self.pixel_buffer,
                     .{ .mvp_matrix = self.mvp_matrix, },
-                    self.vertex_buffer.items,
-                    self.vertex_buffer.items.len/4,
+                    self.vertex_buffer.items[first_vertex..][0..vertex_count],
+                    @divExact(vertex_count, 4),
                     .{ .viewport_matrix = self.viewport_matrix, }
                 );
-                self.vertex_buffer.clearAndFree();
+            }
+
+            pub fn flush(self: *Batch) void {
+                self.render_range(0, self.vertex_buffer.items.len);
+                self.vertex_buffer.clearRetainingCapacity();
+            }
+
+            fn deinit(self: *Batch) void {
+                self.vertex_buffer.deinit();
             }
         };
     
     };
 }
 
+/// `output_pixel_type` can be `Indexed`, in which case the palette indices are written as they are (the key color being discarded)
+/// and the render target is turned into colors later on with `pixels.resolve_indexed`
 pub fn PaletteBasedTexturedQuadRenderer(comptime output_pixel_type: type, comptime key_color: ?u4) type {
     return struct {
         
@@ -1612,7 +1649,8 @@ pub fn PaletteBasedTexturedQuadRenderer(comptime output_pixel_type: type, compti
                 .blend_with_background = key_color != null,
                 .do_quad_clipping = true,
                 .do_scissoring = false,
-                .trace = false
+                .trace = false,
+                .blit = .{ .uv_field = "uv" },
             };
 
             inline fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector3f {
@@ -1623,10 +1661,19 @@ pub fn PaletteBasedTexturedQuadRenderer(comptime output_pixel_type: type, compti
             inline fn fragment_shader(context: Context, invariants: Invariant) output_pixel_type {
                 const palette_index = context.palette_based_texture.point_sample(false, invariants.uv);
                 const key_color_enabled = comptime key_color != null;
-                if (key_color_enabled) {
-                    if (palette_index == key_color.?) return output_pixel_type.from(RGBA, RGBA.make(0,0,0,0));
+                // indexed render targets get the index itself, and the palette is applied when they are resolved
+                if (output_pixel_type == Indexed) {
+                    if (key_color_enabled) {
+                        if (palette_index == key_color.?) return Indexed.transparent;
+                    }
+                    return Indexed.make(palette_index);
+                }
+                else {
+                    if (key_color_enabled) {
+                        if (palette_index == key_color.?) return output_pixel_type.from(RGBA, RGBA.make(0,0,0,0));
+                    }
+                    return output_pixel_type.from(BGR, @bitCast(context.palette[palette_index]));
                 }
-                return output_pixel_type.from(BGR, @bitCast(context.palette[palette_index]));
             }
             
             pub const Pipeline = graphics.GraphicsPipelineQuads2D(
@@ -1769,14 +1816,23 @@ pub fn PaletteBasedTexturedQuadRenderer(comptime output_pixel_type: type, compti
                 }
             }
 
-            pub fn flush(self: *Batch) void {
+            /// renders the quads in `vertex_buffer.items[first_vertex..first_vertex+vertex_count]`, keeping the vertices
+            pub fn render_range(self: *Batch, first_vertex: usize, vertex_count: usize) void {
                 const context = shader.Context {
                     .palette_based_texture = self.palette_based_texture,
                     .palette = self.palette,
                     .mvp_matrix = self.mvp_matrix,
                 };
-                shader.Pipeline.render(self.pixel_buffer, context, self.vertex_buffer.items, @divExact(self.vertex_buffer.items.len, 4), .{ .viewport_matrix = self.viewport_matrix });
-                self.vertex_buffer.clearAndFree();
+                shader.Pipeline.render(self.pixel_buffer, context, self.vertex_buffer.items[first_vertex..][0..vertex_count], @divExact(vertex_count, 4), .{ .viewport_matrix = self.viewport_matrix });
+            }
+
+            pub fn flush(self: *Batch) void {
+                self.render_range(0, self.vertex_buffer.items.len);
+                self.vertex_buffer.clearRetainingCapacity();
+            }
+
+            fn deinit(self: *Batch) void {
+                self.vertex_buffer.deinit();
             }
             
         };
@@ -1784,8 +1840,128 @@ pub fn PaletteBasedTexturedQuadRenderer(comptime output_pixel_type: type, compti
     };
 }
 
-// TODO allow to continue batches if not explicitly asked to use a different batch, or if the continuation is just imposible (for example, when textures used are different)
-// TODO add layers!
+/// Keeps a map pre-rasterized in chunks of `chunk_tiles`x`chunk_tiles` tiles, in the output pixel type, so that drawing the map
+/// takes a few blits rather than a textured quad per tile. Every chunk keeps a copy of the tiles it was rasterized with and the
+/// cache keeps a copy of the palette and atlas, so changes to any of them are detected and only what changed is rasterized again.
+/// Only maps of 8x8 tiles from an atlas of 16x16 sprites are supported. With an `Indexed` output the chunks hold the palette indices.
+pub fn TilemapCache(comptime output_pixel_type: type) type {
+    return struct {
+
+        const Self = @This();
+
+        pub const tile_size = 8;
+        pub const atlas_columns = 16;
+        pub const chunk_tiles = 16;
+        const chunk_size = tile_size * chunk_tiles;
+        const map_rows = 136;
+        const map_columns = 240;
+        const chunk_rows = (map_rows + chunk_tiles - 1) / chunk_tiles;
+        const chunk_columns = (map_columns + chunk_tiles - 1) / chunk_tiles;
+        const atlas_size = tile_size * tile_size * atlas_columns * atlas_columns;
+
+        const Chunk = struct {
+            pixels: Buffer2D(output_pixel_type),
+            tiles: [chunk_tiles][chunk_tiles]u8,
+            valid: bool,
+        };
+
+        allocator: std.mem.Allocator,
+        /// allocated the first time they are used
+        chunks: [chunk_rows][chunk_columns]?Chunk,
+        map: ?*const [map_rows][map_columns]u8,
+        palette: tic80.Palette,
+        atlas: [atlas_size]u4,
+
+        pub fn init(allocator: std.mem.Allocator) Self {
+            var self: Self = undefined;
+            self.allocator = allocator;
+            self.map = null;
+            for (&self.chunks) |*row| @memset(row, null);
+            return self;
+        }
+
+        pub fn deinit(self: *Self) void {
+            for (&self.chunks) |*row| {
+                for (row) |*maybe_chunk| {
+                    if (maybe_chunk.*) |chunk| self.allocator.free(chunk.pixels.data);
+                    maybe_chunk.* = null;
+                }
+            }
+        }
+
+        pub fn supports(comptime grid_cell_dimensions: Vec2(usize), comptime grid_dimensions: Vec2(usize), atlas: Buffer2D(u4)) bool {
+            return grid_cell_dimensions.x == tile_size and grid_cell_dimensions.y == tile_size and grid_dimensions.x == atlas_columns and grid_dimensions.y == atlas_columns
+                and atlas.width == tile_size * atlas_columns and atlas.data.len == atlas_size;
+        }
+
+        /// Forces every chunk to be rasterized again the next time it is used
+        pub fn invalidate(self: *Self) void {
+            for (&self.chunks) |*row| {
+                for (row) |*maybe_chunk| {
+                    if (maybe_chunk.*) |*chunk| chunk.valid = false;
+                }
+            }
+        }
+
+        /// Invalidates everything if the map, palette or atlas are not the ones the chunks were rasterized with
+        pub fn validate(self: *Self, map: *const [map_rows][map_columns]u8, palette: *const tic80.Palette, atlas: Buffer2D(u4)) void {
+            const same_map = if (self.map) |cached_map| cached_map == map else false;
+            if (same_map and std.mem.eql(u24, &self.palette, palette) and std.mem.eql(u4, &self.atlas, atlas.data)) return;
+            self.invalidate();
+            self.map = map;
+            self.palette = palette.*;
+            @memcpy(&self.atlas, atlas.data);
+        }
+
+        /// The pixels of the chunk at `chunk_x`, `chunk_y` (in chunks, bottom left being 0, 0), rasterized again only if its tiles changed.
+        /// Call `validate` first
+        pub fn get(self: *Self, chunk_x: usize, chunk_y: usize) !Buffer2D(output_pixel_type) {
+            const maybe_chunk = &self.chunks[chunk_y][chunk_x];
+            if (maybe_chunk.* == null) {
+                const data = try self.allocator.alloc(output_pixel_type, chunk_size * chunk_size);
+                maybe_chunk.* = .{ .pixels = Buffer2D(output_pixel_type).from(data, chunk_size), .tiles = undefined, .valid = false };
+            }
+            const chunk = &maybe_chunk.*.?;
+
+            var tiles: [chunk_tiles][chunk_tiles]u8 = undefined;
+            for (&tiles, 0..) |*row, tile_y| {
+                const map_y = chunk_y * chunk_tiles + tile_y;
+                if (map_y >= map_rows) @memset(row, 0)
+                else @memcpy(row, self.map.?[map_y][chunk_x * chunk_tiles ..][0..chunk_tiles]);
+            }
+            if (chunk.valid and std.mem.eql(u8, std.mem.asBytes(&tiles), std.mem.asBytes(&chunk.tiles))) return chunk.pixels;
+
+            chunk.tiles = tiles;
+            chunk.valid = true;
+            self.rasterize(chunk);
+            return chunk.pixels;
+        }
+
+        fn rasterize(self: *Self, chunk: *Chunk) void {
+            var colors: [16]output_pixel_type = undefined;
+            for (&colors, self.palette, 0..) |*out_color, palette_color, palette_index| {
+                out_color.* = if (output_pixel_type == Indexed) Indexed.make(@intCast(palette_index)) else output_pixel_type.from(BGR, @bitCast(palette_color));
+            }
+            const atlas_width = tile_size * atlas_columns;
+            for (chunk.tiles, 0..) |row, tile_y| {
+                for (row, 0..) |sprite_index, tile_x| {
+                    const atlas_left = @as(usize, sprite_index % atlas_columns) * tile_size;
+                    const atlas_bottom = @as(usize, sprite_index / atlas_columns) * tile_size;
+                    for (0..tile_size) |y| {
+                        const source = self.atlas[atlas_left + atlas_width * (atlas_bottom + y) ..][0..tile_size];
+                        const destination = chunk.pixels.data[tile_x * tile_size + chunk_size * (tile_y * tile_size + y) ..][0..tile_size];
+                        for (destination, source) |*pixel, palette_index| pixel.* = colors[palette_index];
+                    }
+                }
+            }
+        }
+    };
+}
+
+/// Collects the draws of a frame and renders them all on `flush_all`. Every type of renderer keeps a single vertex buffer which
+/// retains its capacity between frames, and draws are ranges of it. The draws are sorted by layer first, and then either kept
+/// in the order they were added or grouped by renderer type, texture and palette, see `set_layer`. Draws which end up next to
+/// each other, with the same state and contiguous vertices, are rendered together.
 pub fn Renderer(comptime output_pixel_type: type) type {
     return struct {
 
@@ -1796,25 +1972,36 @@ pub fn Renderer(comptime output_pixel_type: type) type {
         const SurfaceRendererImpl = StandardQuadRenderer(output_pixel_type, output_pixel_type);
         const PaletteBasedTexturedQuadRendererImpl = PaletteBasedTexturedQuadRenderer(output_pixel_type, null);
         const PaletteBasedTexturedQuadRendererBlendedImpl = PaletteBasedTexturedQuadRenderer(output_pixel_type, 0);
+        const TilemapCacheImpl = TilemapCache(output_pixel_type);
 
         pub const ExtraParameters = struct {
             mirror_horizontally: bool = false,
             blend: bool = false,
         };
 
-        const total_number_of_renderer_types = @typeInfo(RendererType).Enum.fields.len;
-        batches_created_per_type: [total_number_of_renderer_types] usize,
+        pub const LayerSorting = enum {
+            /// draws are rendered in the same order they were added
+            submission_order,
+            /// draws are grouped by renderer (surfaces, tiles and sprites, blended sprites, shapes and last text), texture and palette.
+            /// Draws within the same group keep the order they were added in
+            by_state,
+        };
 
         allocator: std.mem.Allocator,
 
-        batches: std.ArrayList(BatchDescriptor),
-        current_batch: BatchDescriptor,
+        commands: std.ArrayList(DrawCommand),
+        layer: u16,
+        sorting: LayerSorting,
+        /// increases with every new command, so that sorting by it keeps the order of submission
+        sequence: u32,
+
+        batch_text: TextRendererImpl.Batch,
+        batch_shapes: ShapeRendererImpl.Batch,
+        batch_palette_based_textured_quads: PaletteBasedTexturedQuadRendererImpl.Batch,
+        batch_palette_based_textured_quads_blended: PaletteBasedTexturedQuadRendererBlendedImpl.Batch,
+        batch_surfaces: SurfaceRendererImpl.Batch,
 
-        batches_text: std.ArrayList(TextRendererImpl.Batch),
-        batches_shapes: std.ArrayList(ShapeRendererImpl.Batch),
-        batches_palette_based_textured_quads: std.ArrayList(PaletteBasedTexturedQuadRendererImpl.Batch),
-        batches_palette_based_textured_quads_blended: std.ArrayList(PaletteBasedTexturedQuadRendererBlendedImpl.Batch),
-        batches_surfaces: std.ArrayList(SurfaceRendererImpl.Batch),
+        tilemap_cache: TilemapCacheImpl,
 
         pixel_buffer: Buffer2D(output_pixel_type),
         mvp_matrix: M33,
@@ -1823,279 +2010,273 @@ pub fn Renderer(comptime output_pixel_type: type) type {
         pub fn init(allocator: std.mem.Allocator) !Self {
             var self: Self = undefined;
             self.allocator = allocator;
-                        
-            self.batches_text = std.ArrayList(TextRendererImpl.Batch).init(allocator);
-            self.batches_shapes = std.ArrayList(ShapeRendererImpl.Batch).init(allocator);
-            self.batches_surfaces = std.ArrayList(SurfaceRendererImpl.Batch).init(allocator);
-            self.batches_palette_based_textured_quads = std.ArrayList(PaletteBasedTexturedQuadRendererImpl.Batch).init(allocator);
-            self.batches_palette_based_textured_quads_blended = std.ArrayList(PaletteBasedTexturedQuadRendererBlendedImpl.Batch).init(allocator);
-
-            self.batches = std.ArrayList(BatchDescriptor).init(allocator);
-
-            self.current_batch = .{
-                .index = 0,
-                .renderer_type = .none
-            };
-
-            for (0..total_number_of_renderer_types) |i| self.batches_created_per_type[i] = 0;
-
+            self.commands = std.ArrayList(DrawCommand).init(allocator);
+            self.layer = 0;
+            self.sorting = .submission_order;
+            self.sequence = 0;
+
+            self.batch_text = TextRendererImpl.Batch.init(allocator, undefined, undefined, undefined);
+            self.batch_shapes = ShapeRendererImpl.Batch.init(allocator, undefined, undefined, undefined);
+            self.batch_surfaces = SurfaceRendererImpl.Batch.init(allocator, undefined, undefined, undefined, undefined);
+            self.batch_palette_based_textured_quads = try PaletteBasedTexturedQuadRendererImpl.Batch.init(allocator, undefined, undefined, undefined, undefined, undefined);
+            self.batch_palette_based_textured_quads_blended = try PaletteBasedTexturedQuadRendererBlendedImpl.Batch.init(allocator, undefined, undefined, undefined, undefined, undefined);
+            self.tilemap_cache = TilemapCacheImpl.init(allocator);
             return self;
         }
 
+        pub fn deinit(self: *Self) void {
+            self.commands.deinit();
+            self.batch_text.deinit();
+            self.batch_shapes.deinit();
+            self.batch_surfaces.deinit();
+            self.batch_palette_based_textured_quads.deinit();
+            self.batch_palette_based_textured_quads_blended.deinit();
+            self.tilemap_cache.deinit();
+        }
+
         pub fn set_context(self: *Self, pixel_buffer: Buffer2D(output_pixel_type), mvp_matrix: M33, viewport_matrix: M33) void {
             self.pixel_buffer = pixel_buffer;
             self.mvp_matrix = mvp_matrix;
             self.viewport_matrix = viewport_matrix;
         }
 
-        pub fn add_quad_from_bb(self: *Self, bb: BoundingBox(f32), tint: RGBA) !void {
-            const correct_renderer = RendererType.shape;
-            if (self.current_batch.renderer_type == correct_renderer) {
-                const batch = &self.batches_shapes.items[self.batches_shapes.items.len-1];
-                try batch.add_quad_from_bb(bb, tint);
-                return;
-            }
+        /// Every draw added from now on goes to `layer`, lower layers are rendered first. A layer is meant to always be used with the same `sorting`.
+        /// Goes back to layer 0 in `submission_order` after `flush_all`
+        pub fn set_layer(self: *Self, layer: u16, sorting: LayerSorting) void {
+            self.layer = layer;
+            self.sorting = sorting;
+        }
 
-            // save previous batch
-            if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-            // set new batch
-            self.current_batch = .{
-                .renderer_type = correct_renderer,
-                .index = self.batches_shapes.items.len
-            };
-            self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-            const new_batch = try self.batches_shapes.addOne();
-            new_batch.* = ShapeRendererImpl.Batch.init(self.allocator, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-            try new_batch.add_quad_from_bb(bb, tint);
+        pub fn add_quad_from_bb(self: *Self, bb: BoundingBox(f32), tint: RGBA) !void {
+            try self.begin_command(.shape);
+            try self.batch_shapes.add_quad_from_bb(bb, tint);
         }
         
         pub fn add_quad_border(self: *Self, bb: BoundingBox(f32), thickness: f32, tint: RGBA) !void {
-            const correct_renderer = RendererType.shape;
-            if (self.current_batch.renderer_type == correct_renderer) {
-                const batch = &self.batches_shapes.items[self.current_batch.index];
-                try batch.add_quad_border(bb, thickness, tint);
-                return;
-            }
-
-            // save previous batch
-            if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-            // initialize and set new batch
-            self.current_batch = .{
-                .renderer_type = correct_renderer,
-                .index = self.batches_shapes.items.len
-            };
-            self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-            const new_batch = try self.batches_shapes.addOne();
-            new_batch.* = ShapeRendererImpl.Batch.init(self.allocator, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-            try new_batch.add_quad_border(bb, thickness, tint);
+            try self.begin_command(.shape);
+            try self.batch_shapes.add_quad_border(bb, thickness, tint);
         }
         
         pub fn add_palette_based_textured_quad(self: *Self, dest_bb: BoundingBox(f32), src_bb: BoundingBox(f32), palette_based_texture: Buffer2D(u4), palette: *tic80.Palette) !void {
-            const correct_renderer = RendererType.palette_based_textured_quad_renderer;
-            if (self.current_batch.renderer_type == correct_renderer) {
-                const batch = &self.batches_palette_based_textured_quads.items[self.current_batch.index];
-                // if the batch is using same palette and texture, keep using it
-                if (batch.palette_based_texture.data.ptr == palette_based_texture.data.ptr and batch.palette == palette) {
-                    try batch.add_palette_based_textured_quad(dest_bb, src_bb);
-                    return;
-                }
-            }
-
-            // save previous batch
-            if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-
-            // initialize and set new batch
-            self.current_batch = .{
-                .renderer_type = correct_renderer,
-                .index = self.batches_palette_based_textured_quads.items.len
-            };
-            self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-            const new_batch = try self.batches_palette_based_textured_quads.addOne();
-            new_batch.* = try PaletteBasedTexturedQuadRendererImpl.Batch.init(self.allocator, palette, palette_based_texture, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-            try new_batch.add_palette_based_textured_quad(dest_bb, src_bb);
+            try self.begin_command(.{ .palette_based_textured_quad_renderer = .{ .texture = palette_based_texture, .palette = palette } });
+            try self.batch_palette_based_textured_quads.add_palette_based_textured_quad(dest_bb, src_bb);
         }
 
         pub fn add_blit_texture_to_bb(self: *Self, bb: BoundingBox(f32), texture: Buffer2D(output_pixel_type)) !void {
-            const correct_renderer = RendererType.surface;
-            if (self.current_batch.renderer_type == correct_renderer) {
-                const batch = &self.batches_surfaces.items[self.current_batch.index];
-                if (batch.texture.data.ptr == texture.data.ptr) {
-                    try batch.add_blit_texture_to_bb(bb);
-                    return;
-                }
-            }
-            // save previous batch
-            if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-            // initialize and set new batch
-            self.current_batch = .{
-                .renderer_type = correct_renderer,
-                .index = self.batches_surfaces.items.len
-            };
-            self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-            const new_batch = try self.batches_surfaces.addOne();
-            new_batch.* = SurfaceRendererImpl.Batch.init(self.allocator, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix, texture);
-            try new_batch.add_blit_texture_to_bb(bb);
+            try self.begin_command(.{ .surface = texture });
+            self.batch_surfaces.texture = texture;
+            try self.batch_surfaces.add_blit_texture_to_bb(bb);
+        }
+
+        /// `region` is in texels of the texture
+        pub fn add_blit_texture_region_to_bb(self: *Self, bb: BoundingBox(f32), texture: Buffer2D(output_pixel_type), region: BoundingBox(f32)) !void {
+            try self.begin_command(.{ .surface = texture });
+            try self.batch_surfaces.add_blit_texture_region_to_bb(bb, region);
         }
         
         pub fn add_text(self: *Self, pos: Vector2f, comptime fmt: []const u8, args: anytype, tint: RGBA) !void {
-            const correct_renderer = RendererType.text;
-            if (self.current_batch.renderer_type == correct_renderer) {
-                const batch = &self.batches_text.items[self.current_batch.index];
-                try batch.add_text(pos, fmt, args, tint);
-                return;
-            }
-
-            // save previous batch
-            if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-            // initialize and set new batch
-            self.current_batch = .{
-                .renderer_type = correct_renderer,
-                .index = self.batches_text.items.len
-            };
-            self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-            const new_batch = try self.batches_text.addOne();
-            new_batch.* = TextRendererImpl.Batch.init(self.allocator, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-            try new_batch.add_text(pos, fmt, args, tint);
+            try self.begin_command(.text);
+            try self.batch_text.add_text(pos, fmt, args, tint);
         }
         
         pub fn add_sprite_from_atlas_by_index(self: *Self, comptime grid_cell_dimensions: Vec2(usize), comptime grid_dimensions: Vec2(usize), palette: *tic80.Palette, palette_based_texture: Buffer2D(u4), sprite_index: usize, dest_bb: BoundingBox(f32), parameters: ExtraParameters) !void {
+            const palette_based_state = PaletteBasedState { .texture = palette_based_texture, .palette = palette };
             if (parameters.blend) {
-                const correct_renderer = RendererType.palette_based_textured_quad_blended_renderer;
-                if (self.current_batch.renderer_type == correct_renderer) {
-                    const batch = &self.batches_palette_based_textured_quads_blended.items[self.current_batch.index];
-                    // if the batch is using same palette and texture, keep using it
-                    if (batch.palette_based_texture.data.ptr == palette_based_texture.data.ptr and batch.palette == palette) {
-                        try batch.add_sprite_from_atlas_by_index(grid_cell_dimensions, grid_dimensions, sprite_index, dest_bb, .{ .mirror_horizontally = parameters.mirror_horizontally });
-                        return;
-                    }
-                }
-
-                // save previous batch
-                if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-
-                // initialize and set new batch
-                self.current_batch = .{
-                    .renderer_type = correct_renderer,
-                    .index = self.batches_palette_based_textured_quads_blended.items.len
-                };
-                self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-                const new_batch = try self.batches_palette_based_textured_quads_blended.addOne();
-                new_batch.* = try PaletteBasedTexturedQuadRendererBlendedImpl.Batch.init(self.allocator, palette, palette_based_texture, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-                try new_batch.add_sprite_from_atlas_by_index(grid_cell_dimensions, grid_dimensions, sprite_index, dest_bb, .{ .mirror_horizontally = parameters.mirror_horizontally });
+                try self.begin_command(.{ .palette_based_textured_quad_blended_renderer = palette_based_state });
+                try self.batch_palette_based_textured_quads_blended.add_sprite_from_atlas_by_index(grid_cell_dimensions, grid_dimensions, sprite_index, dest_bb, .{ .mirror_horizontally = parameters.mirror_horizontally });
             }
             else {
-                const correct_renderer = RendererType.palette_based_textured_quad_renderer;
-                if (self.current_batch.renderer_type == correct_renderer) {
-                    const batch = &self.batches_palette_based_textured_quads.items[self.current_batch.index];
-                    // if the batch is using same palette and texture, keep using it
-                    if (batch.palette_based_texture.data.ptr == palette_based_texture.data.ptr and batch.palette == palette) {
-                        try batch.add_sprite_from_atlas_by_index(grid_cell_dimensions, grid_dimensions, sprite_index, dest_bb, .{ .mirror_horizontally = parameters.mirror_horizontally });
-                        return;
-                    }
-                }
-
-                // save previous batch
-                if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
-
-                // initialize and set new batch
-                self.current_batch = .{
-                    .renderer_type = correct_renderer,
-                    .index = self.batches_palette_based_textured_quads.items.len
-                };
-                self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-                const new_batch = try self.batches_palette_based_textured_quads.addOne();
-                new_batch.* = try PaletteBasedTexturedQuadRendererImpl.Batch.init(self.allocator, palette, palette_based_texture, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-                try new_batch.add_sprite_from_atlas_by_index(grid_cell_dimensions, grid_dimensions, sprite_index, dest_bb, .{ .mirror_horizontally = parameters.mirror_horizontally });
+                try self.begin_command(.{ .palette_based_textured_quad_renderer = palette_based_state });
+                try self.batch_palette_based_textured_quads.add_sprite_from_atlas_by_index(grid_cell_dimensions, grid_dimensions, sprite_index, dest_bb, .{ .mirror_horizontally = parameters.mirror_horizontally });
             }
         }
 
+        /// The map is drawn from the chunks of the tilemap cache, as long as its tiles and atlas are of the sizes the cache supports
         pub fn add_map(self: *Self, comptime grid_cell_dimensions: Vec2(usize), comptime grid_dimensions: Vec2(usize), palette: *tic80.Palette, palette_based_texture: Buffer2D(u4), map: *[136][240]u8, map_bb: BoundingBox(usize), dest_bb: BoundingBox(f32)) !void {
-            const correct_renderer = RendererType.palette_based_textured_quad_renderer;
-            if (self.current_batch.renderer_type == correct_renderer) {
-                const batch = &self.batches_palette_based_textured_quads.items[self.current_batch.index];
-                // if the batch is using same palette and texture, keep using it
-                if (batch.palette_based_texture.data.ptr == palette_based_texture.data.ptr and batch.palette == palette) {
-                    try batch.add_map(grid_cell_dimensions, grid_dimensions, map, map_bb, dest_bb);
-                    return;
+            if (TilemapCacheImpl.supports(grid_cell_dimensions, grid_dimensions, palette_based_texture)) {
+                const chunk_tiles = TilemapCacheImpl.chunk_tiles;
+                const tile_size = TilemapCacheImpl.tile_size;
+                self.tilemap_cache.validate(map, palette, palette_based_texture);
+                for (map_bb.bottom / chunk_tiles .. map_bb.top / chunk_tiles + 1) |chunk_y| {
+                    for (map_bb.left / chunk_tiles .. map_bb.right / chunk_tiles + 1) |chunk_x| {
+                        const chunk = try self.tilemap_cache.get(chunk_x, chunk_y);
+                        // the tiles of the chunk inside of `map_bb`, both included
+                        const tiles = BoundingBox(usize).from(
+                            @min(map_bb.top, (chunk_y + 1) * chunk_tiles - 1),
+                            @max(map_bb.bottom, chunk_y * chunk_tiles),
+                            @max(map_bb.left, chunk_x * chunk_tiles),
+                            @min(map_bb.right, (chunk_x + 1) * chunk_tiles - 1),
+                        );
+                        const region = BoundingBox(usize).from(
+                            (tiles.top + 1 - chunk_y * chunk_tiles) * tile_size,
+                            (tiles.bottom - chunk_y * chunk_tiles) * tile_size,
+                            (tiles.left - chunk_x * chunk_tiles) * tile_size,
+                            (tiles.right + 1 - chunk_x * chunk_tiles) * tile_size,
+                        );
+                        const destination = BoundingBox(usize).from(
+                            (tiles.top + 1 - map_bb.bottom) * tile_size,
+                            (tiles.bottom - map_bb.bottom) * tile_size,
+                            (tiles.left - map_bb.left) * tile_size,
+                            (tiles.right + 1 - map_bb.left) * tile_size,
+                        ).to(f32).offset(Vector2f.from(dest_bb.left, dest_bb.bottom));
+                        try self.add_blit_texture_region_to_bb(destination, chunk, region.to(f32));
+                    }
                 }
+                return;
             }
+            try self.begin_command(.{ .palette_based_textured_quad_renderer = .{ .texture = palette_based_texture, .palette = palette } });
+            try self.batch_palette_based_textured_quads.add_map(grid_cell_dimensions, grid_dimensions, map, map_bb, dest_bb);
+        }
 
-            // save previous batch
-            if (self.current_batch.renderer_type != .none) try self.batches.append(self.current_batch);
+        /// Makes sure that the vertices about to be added belong to a command with `state`, continuing the last command if possible
+        fn begin_command(self: *Self, state: State) !void {
+            const sequence: u32 = if (self.sorting == .submission_order) self.sequence else 0;
+            if (self.commands.items.len > 0) {
+                const last = self.commands.items[self.commands.items.len - 1];
+                if (last.layer == self.layer and last.sequence == sequence and last.state.same_as(state)) return;
+            }
+            self.sequence += 1;
+            try self.commands.append(.{
+                .layer = self.layer,
+                .sequence = if (self.sorting == .submission_order) self.sequence else 0,
+                .state = state,
+                .first_vertex = self.vertex_count(state),
+                .vertex_count = 0,
+            });
+        }
 
-            // initialize and set new batch
-            self.current_batch = .{
-                .renderer_type = correct_renderer,
-                .index = self.batches_palette_based_textured_quads.items.len
+        fn vertex_count(self: *Self, state: State) usize {
+            return switch (state) {
+                .text => self.batch_text.vertex_buffer.items.len,
+                .shape => self.batch_shapes.vertex_buffer.items.len,
+                .surface => self.batch_surfaces.vertex_buffer.items.len,
+                .palette_based_textured_quad_renderer => self.batch_palette_based_textured_quads.vertex_buffer.items.len,
+                .palette_based_textured_quad_blended_renderer => self.batch_palette_based_textured_quads_blended.vertex_buffer.items.len,
             };
-            self.batches_created_per_type[@intFromEnum(correct_renderer)] += 1;
-            const new_batch = try self.batches_palette_based_textured_quads.addOne();
-            new_batch.* = try PaletteBasedTexturedQuadRendererImpl.Batch.init(self.allocator, palette, palette_based_texture, self.pixel_buffer, self.mvp_matrix, self.viewport_matrix);
-            try new_batch.add_map(grid_cell_dimensions, grid_dimensions, map, map_bb, dest_bb);
         }
 
         pub fn flush_all(self: *Self) !void {
-            if (self.current_batch.renderer_type == .none) return;
-            try self.batches.append(self.current_batch);
-
-            // TODO count the number of batches that have been created per pipeline
-            // and then here count the number of batches gone through. The numbers should match, and if not, then there is a bug and memory is leaking
-            var batch_counter_per_type: [total_number_of_renderer_types] usize = undefined;
-            for (0..total_number_of_renderer_types) |i| batch_counter_per_type[i] = 0;
-
-            var total: usize = 0;
-            for (self.batches.items) |batch| {
-                batch_counter_per_type[@intFromEnum(batch.renderer_type)] += 1;
-                const index = batch.index;
-                switch (batch.renderer_type) {
-                    .shape => {
-                        const batch_to_render = &self.batches_shapes.items[index];
-                        batch_to_render.flush();
-                    },
-                    .text => {
-                        const batch_to_render = &self.batches_text.items[index];
-                        batch_to_render.flush();
-                    },
-                    .surface => {
-                        const batch_to_render = &self.batches_surfaces.items[index];
-                        batch_to_render.flush();
-                    },
-                    .palette_based_textured_quad_renderer => {
-                        const batch_to_render = &self.batches_palette_based_textured_quads.items[index];
-                        batch_to_render.flush();
-                    },
-                    .palette_based_textured_quad_blended_renderer => {
-                        const batch_to_render = &self.batches_palette_based_textured_quads_blended.items[index];
-                        batch_to_render.flush();
-                    },
-                    .none => unreachable
+            const commands = self.commands.items;
+            // every batch only grows, so a command ends where the next command of the same renderer starts
+            var end: [@typeInfo(RendererType).Enum.fields.len]usize = undefined;
+            inline for (@typeInfo(RendererType).Enum.fields, 0..) |field, type_index| end[type_index] = self.vertex_count(@unionInit(State, field.name, undefined));
+            var i = commands.len;
+            while (i > 0) {
+                i -= 1;
+                const renderer_index = @intFromEnum(@as(RendererType, commands[i].state));
+                commands[i].vertex_count = end[renderer_index] - commands[i].first_vertex;
+                end[renderer_index] = commands[i].first_vertex;
+            }
+
+            std.sort.block(DrawCommand, commands, {}, DrawCommand.less_than);
+
+            inline for (.{ &self.batch_text, &self.batch_shapes, &self.batch_surfaces, &self.batch_palette_based_textured_quads, &self.batch_palette_based_textured_quads_blended }) |batch| {
+                batch.pixel_buffer = self.pixel_buffer;
+                batch.mvp_matrix = self.mvp_matrix;
+                batch.viewport_matrix = self.viewport_matrix;
+            }
+
+            if (commands.len > 0) {
+                var pending = commands[0];
+                for (commands[1..]) |command| {
+                    if (command.state.same_as(pending.state) and command.first_vertex == pending.first_vertex + pending.vertex_count) {
+                        pending.vertex_count += command.vertex_count;
+                        continue;
+                    }
+                    self.render_command(pending);
+                    pending = command;
                 }
-                total += 1;
-            }
-
-            // Dont check on .none
-            for (1..total_number_of_renderer_types) |i| std.debug.assert(batch_counter_per_type[i] == self.batches_created_per_type[i]);
-            for (0..total_number_of_renderer_types) |i| self.batches_created_per_type[i] = 0;
-
-            self.batches.clearRetainingCapacity();
-            self.batches_shapes.clearRetainingCapacity();
-            self.batches_surfaces.clearRetainingCapacity();
-            self.batches_text.clearRetainingCapacity();
-            self.batches_palette_based_textured_quads.clearRetainingCapacity();
-            self.batches_palette_based_textured_quads_blended.clearRetainingCapacity();
-            self.current_batch = .{
-                .index = 0,
-                .renderer_type = .none
-            };
+                self.render_command(pending);
+            }
+
+            self.commands.clearRetainingCapacity();
+            self.batch_text.vertex_buffer.clearRetainingCapacity();
+            self.batch_shapes.vertex_buffer.clearRetainingCapacity();
+            self.batch_surfaces.vertex_buffer.clearRetainingCapacity();
+            self.batch_palette_based_textured_quads.vertex_buffer.clearRetainingCapacity();
+            self.batch_palette_based_textured_quads_blended.vertex_buffer.clearRetainingCapacity();
+            self.set_layer(0, .submission_order);
+            self.sequence = 0;
+        }
+
+        fn render_command(self: *Self, command: DrawCommand) void {
+            if (command.vertex_count == 0) return;
+            switch (command.state) {
+                .text => self.batch_text.render_range(command.first_vertex, command.vertex_count),
+                .shape => self.batch_shapes.render_range(command.first_vertex, command.vertex_count),
+                .surface => |texture| {
+                    self.batch_surfaces.texture = texture;
+                    self.batch_surfaces.render_range(command.first_vertex, command.vertex_count);
+                },
+                .palette_based_textured_quad_renderer => |palette_based_state| {
+                    self.batch_palette_based_textured_quads.palette_based_texture = palette_based_state.texture;
+                    self.batch_palette_based_textured_quads.palette = palette_based_state.palette;
+                    self.batch_palette_based_textured_quads.render_range(command.first_vertex, command.vertex_count);
+                },
+                .palette_based_textured_quad_blended_renderer => |palette_based_state| {
+                    self.batch_palette_based_textured_quads_blended.palette_based_texture = palette_based_state.texture;
+                    self.batch_palette_based_textured_quads_blended.palette = palette_based_state.palette;
+                    self.batch_palette_based_textured_quads_blended.render_range(command.first_vertex, command.vertex_count);
+                },
+            }
         }
 
+        /// in the order they are drawn within a layer sorted `by_state`
         const RendererType = enum {
-            none, text, shape, surface, palette_based_textured_quad_renderer, palette_based_textured_quad_blended_renderer
+            surface, palette_based_textured_quad_renderer, palette_based_textured_quad_blended_renderer, shape, text
+        };
+
+        const PaletteBasedState = struct {
+            texture: Buffer2D(u4),
+            palette: *tic80.Palette,
+        };
+
+        /// which renderer a command uses, and the texture and palette for the ones that need them
+        const State = union(RendererType) {
+            surface: Buffer2D(output_pixel_type),
+            palette_based_textured_quad_renderer: PaletteBasedState,
+            palette_based_textured_quad_blended_renderer: PaletteBasedState,
+            shape: void,
+            text: void,
+
+            fn texture_address(self: State) usize {
+                return switch (self) {
+                    .surface => |texture| @intFromPtr(texture.data.ptr),
+                    .palette_based_textured_quad_renderer, .palette_based_textured_quad_blended_renderer => |palette_based_state| @intFromPtr(palette_based_state.texture.data.ptr),
+                    .shape, .text => 0,
+                };
+            }
+
+            fn palette_address(self: State) usize {
+                return switch (self) {
+                    .palette_based_textured_quad_renderer, .palette_based_textured_quad_blended_renderer => |palette_based_state| @intFromPtr(palette_based_state.palette),
+                    .surface, .shape, .text => 0,
+                };
+            }
+
+            fn same_as(self: State, other: State) bool {
+                return @as(RendererType, self) == @as(RendererType, other) and self.texture_address() == other.texture_address() and self.palette_address() == other.palette_address();
+            }
         };
 
-        const BatchDescriptor = struct {
-            renderer_type: RendererType,
-            index: usize,
+        const DrawCommand = struct {
+            layer: u16,
+            /// 0 for the layers sorted `by_state`
+            sequence: u32,
+            state: State,
+            first_vertex: usize,
+            /// only known once the frame is flushed
+            vertex_count: usize,
+
+            fn less_than(_: void, a: DrawCommand, b: DrawCommand) bool {
+                if (a.layer != b.layer) return a.layer < b.layer;
+                if (a.sequence != b.sequence) return a.sequence < b.sequence;
+                const a_type = @intFromEnum(@as(RendererType, a.state));
+                const b_type = @intFromEnum(@as(RendererType, b.state));
+                if (a_type != b_type) return a_type < b_type;
+                if (a.state.texture_address() != b.state.texture_address()) return a.state.texture_address() < b.state.texture_address();
+                return a.state.palette_address() < b.state.palette_address();
+            }
         };
     };
 }
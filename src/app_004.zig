@@ -24,6 +24,7 @@ const Sound = wav.Sound;
 const TextRenderer = @import("text.zig").TextRenderer(platform.OutPixelType, 1024, 1);
 const Renderer = @import("app_003.zig").Renderer;
 const Resources = @import("app_003.zig").Resources;
+const upscale = @import("upscale.zig").upscale;
 
 const windows = @import("windows.zig");
 const wasm = @import("wasm.zig");
@@ -57,6 +58,7 @@ const State = struct {
     ui: ImmediateModeGui,
     resources: Resources,
     scrolling_log: ScrollingLog(1024*3),
+    renderer: Renderer(platform.OutPixelType),
 };
 
 var state: State = undefined;
@@ -70,6 +72,7 @@ pub fn init(allocator: std.mem.Allocator) anyerror!void {
     state.entities = try game.ECS.init_capacity(allocator, 32);
     ImmediateModeGui.init(&state.ui);
     state.resources = try Resources.init(allocator);
+    state.renderer = try Renderer(platform.OutPixelType).init(allocator);
     const bytes = try Application.read_file_sync(allocator, "res/resources.bin");
     defer allocator.free(bytes);
     try state.resources.load_from_bytes(bytes);
@@ -287,7 +290,7 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
         break :blk Application.perf.profile_end(profile);
     };
 
-    var renderer: Renderer(platform.OutPixelType) = undefined;
+    const renderer = &state.renderer;
 
     const ms_taken_render: f32 = blk: {
         const profile = Application.perf.profile_start();
@@ -297,8 +300,6 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
         const viewport_matrix_m33 = M33.viewport(0, 0, w, h);
         const mvp_matrix_33 = projection_matrix_m33.multiply(view_matrix_m33.multiply(M33.identity()));
 
-        renderer = try Renderer(platform.OutPixelType).init(ud.allocator);
-        
         renderer.set_context(
             state.game_render_target,
             mvp_matrix_33,
@@ -394,6 +395,8 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
         }
 
         // render the player skill bar
+        // every skill is a couple of sprites, a border and some text on top, in that order, so let the renderer group them all by type
+        renderer.set_layer(1, .by_state);
         for (players, players_skills, 0..) |player, player_skills, player_index| {
             const offset_extra = player_index*16;
             var cds = state.entities.require_component(game.Cooldowns, player);
@@ -456,7 +459,7 @@ pub fn update(ud: *platform.UpdateData) anyerror!bool {
     // The game is being rendered to a 1/4 size of the window, so scale the image back up to the real size
     const ms_taken_upscale: f32 = blk: {
         const profile = Application.perf.profile_start();
-        scalers.upscale(platform.OutPixelType, state.game_render_target, ud.pixel_buffer, SCALE);
+        upscale(platform.OutPixelType, state.game_render_target, ud.pixel_buffer, SCALE, .{});
         break :blk Application.perf.profile_end(profile);
     };
 
@@ -2142,7 +2145,8 @@ pub fn ShapeRenderer(comptime output_pixel_type: type) type {
                 .blend_with_background = true,
                 .do_quad_clipping = true,
                 .do_scissoring = false,
-                .trace = false
+                .trace = false,
+                .flat_quads = true,
             };
 
             pub const Pipeline = graphics.GraphicsPipelineQuads2D(
@@ -2212,168 +2216,3 @@ pub fn ShapeRenderer(comptime output_pixel_type: type) type {
     };
 }
 
-const scalers = struct {
-    pub fn _upscale_u32_known_scale_asm(src_data: *u32, dst_data: *u32, src_width: u32, src_height: u32, comptime scaling_factor: u32) void {
-        // ; input
-        // rd32| = src_width
-        // ra32| = src_height
-        // rc64| = src_data
-        // rb64| = dst_data
-        // 
-        // ; assembly
-        // ; NOTE this might not be 100% accurate with the actual code below, but it mostly is an accurate
-        // ; representation of the assembly below...
-        // r832|src_width = rd32|src_width
-        // r332|size_of_src_row_in_bytes = r832|src_width * 4
-        // r432|square_of_scaling_factor = comptime scaling_factor*scaling_factor
-        // r432|size_of_dst_row_in_bytes *= r332|size_of_src_row_in_bytes
-        // r064|src_row_end = rc64|src_data
-        // r964|dst_row_end = rb64|dst_data
-        // ra32|src_data_len *=  rd32|src_width
-        // rd64|src_data_end = rc64|src_data + (ra32|src_data_len * 4)
-        // while (rc64|src_data != rd64|src_data_end) {
-        //     ; Calculate the address of the first pixel of the next row in src_data
-        //     r064|src_row_end += r332|size_of_src_row_in_bytes
-        //     ; Calculate the address of the first pixel of the next row in dst_data
-        //     r964|dst_row_end += r432|size_of_dst_row_in_bytes
-        //     while (rb64|dst_data != r964|dst_row_end) {
-        //         push rc64|src_data
-        //         while (rc64|src_data != r064|src_row_end) {
-        //             r132|pixel = *rc64|src_data
-        //             ; TODO look into SIMD to replace this whole loop
-        //             comptime inline for(0..scaling_factor) |_| {
-        //                 *(rb64|dst_data) = r132|pixel
-        //                 rb64|dst_data += 4
-        //             }
-        //             rc64|src_data += 4
-        //         }
-        //         pop rc64|src_data
-        //     }
-        //     rc64|src_data = r064|src_row_end
-        // }
-        
-        const comptime_generated_asm_2 = comptime blk: {
-            var comptime_string: []const u8 = "";
-            for  (0..scaling_factor) |_| {
-                // Tried also this but didnt make any difference as far as I can tell
-                // |mov %%r11d, 4(%%rbx)
-                // |mov %%r11d, 8(%%rbx)
-                // |mov %%r11d, 12(%%rbx)
-                // |mov %%r11d, 14(%%rbx)
-                // |addq $16, %%rbx
-                comptime_string = comptime_string ++
-                    \\    mov %%r11d, (%%rbx)
-                    \\    addq $4, %%rbx
-                    \\
-                ;
-            }
-            break :blk comptime_string;
-        };
-
-        const comptime_generated_asm_1 = std.fmt.comptimePrint(
-            \\    mov ${}, %%r14d
-            \\
-            , .{scaling_factor*scaling_factor}
-        );
-        
-        // This is the code that copies a pixel from scale_factor x pixels of dst
-        const loop_core = if (scaling_factor == 4)
-            // SIMD version when scaling factor is 4
-            // TODO should probably implement the same for scaling factor 2 and 8
-            // TODO additionally I could copy more than 1 pixel: Load p and p+1, fill ymm 256 bit register and write it to memory
-            // although it would need some extra checks probably? Not really needing the extra speed now anyway lol
-            \\    vbroadcastss (%%rcx), %%xmm0
-            \\    movaps %%xmm0, (%%rbx)
-            \\    addq $16, %%rbx
-            \\
-            else
-            \\    mov (%%rcx), %%r11d
-            \\
-            ++ comptime_generated_asm_2 ++
-            \\
-        ;
-
-        // TODO I probably should reset flags and stuff that I'm not checking? I actually dont know...
-        asm volatile (
-            \\    mov %%edx, %%r8d
-            \\    imul $4, %%r8d, %%r13d
-            \\
-            ++ comptime_generated_asm_1 ++
-            \\    imul %%r13d, %%r14d
-            \\    mov %%rcx, %%r10
-            \\    mov %%rbx, %%r9
-            \\    mul %%edx
-            \\    lea (%%rcx,%%rax,4), %%rdx
-            \\._outer:
-            \\    cmp %%rcx, %%rdx
-            \\    je ._outer_end
-            \\    add %%r13, %r10
-            \\    add %%r14, %r9
-            \\._outer_2:
-            \\    cmp %%rbx, %%r9
-            \\    je ._outer_2_end
-            \\    push %%rcx
-            \\._inner:
-            \\    cmp %%rcx, %%r10
-            \\    je ._inner_end
-            \\
-            ++ loop_core ++
-            \\    addq $4, %%rcx
-            \\    jmp ._inner
-            \\._inner_end:
-            \\    pop %%rcx
-            \\    jmp ._outer_2
-            \\._outer_2_end:
-            \\    mov %%r10, %%rcx
-            \\    jmp ._outer
-            \\._outer_end:
-            \\
-            :: [dst_data]"{rbx}"(dst_data),
-            [src_data]"{rcx}"(src_data),
-            [src_width]"{edx}"(src_width),
-            [src_height]"{eax}"(src_height),
-            : "memory"
-        );
-    }
-    pub fn _upscale_u32_known_scale(_src_data: [*]u32, _dst_data: [*]u32, src_width: u32, src_height: u32, comptime scaling_factor: u32) void {
-        const square_of_scaling_factor: u32 = comptime scaling_factor*scaling_factor;
-        // by default input parameters of functions are const
-        var dst_data = _dst_data;
-        var src_data = _src_data;
-
-        const size_of_dst_row: u32 = square_of_scaling_factor * src_width;
-        const src_data_end = src_data + src_width * src_height;
-        var src_row_end = src_data;
-        var dst_row_end = dst_data;
-        while (src_data != src_data_end) {
-            src_row_end += src_width;
-            dst_row_end += size_of_dst_row;
-            while (dst_data != dst_row_end) {
-                const saved_src_data = src_data;
-                while (src_data != src_row_end) {
-                    const pixel = src_data[0];
-                    inline for(0..scaling_factor) |i| {
-                        dst_data[i] = pixel;
-                    }
-                    dst_data += scaling_factor;
-                    src_data += 1;
-                }
-                src_data = saved_src_data;
-            }
-            src_data = src_row_end;
-        }
-    }
-    pub fn upscale_u32_known_scale_asm(comptime pixel_type: type, src: Buffer2D(pixel_type), dst: Buffer2D(pixel_type), comptime scale: u32) void {
-        std.debug.assert(@sizeOf(pixel_type) == @sizeOf(u32));
-        _upscale_u32_known_scale_asm(@ptrCast(@alignCast(src.data)), @ptrCast(@alignCast(dst.data)), @intCast(src.width), @intCast(src.height), scale);
-    }
-    pub fn upscale_u32_known_scale(comptime pixel_type: type, src: Buffer2D(pixel_type), dst: Buffer2D(pixel_type), comptime scale: u32) void {
-        std.debug.assert(@sizeOf(pixel_type) == @sizeOf(u32));
-        _upscale_u32_known_scale(@ptrCast(@alignCast(src.data)), @ptrCast(@alignCast(dst.data)), @intCast(src.width), @intCast(src.height), scale);
-    }
-    pub fn upscale(comptime pixel_type: type, src: Buffer2D(pixel_type), dst: Buffer2D(pixel_type), comptime scale: u32) void {
-        if (builtin.os.tag == .windows and builtin.mode == .Debug) upscale_u32_known_scale_asm(platform.OutPixelType, src, dst, scale)
-        else upscale_u32_known_scale(platform.OutPixelType, src, dst, scale);
-    }
-};
-
@@ -95,8 +95,20 @@ pub fn Buffer2D(comptime T: type) type {
             }
         }
 
+        /// Same as `bilinear_sample`, but with 8.8 fixed point weights and all 4 texels blended at once as integer vectors.
+        /// Addresses are clamped to the texture, so there are no special cases on the borders. Only for pixel types made of 3 or 4 `u8`s
+        pub fn bilinear_sample_fixed_point(self: Self, comptime point_is_normalized: bool, point: Vector2f) T {
+            const footprint = BilinearFootprint.from(point_is_normalized, point, self.width, self.height);
+            return bilinear_blend_fixed_point(T, .{
+                self.data[footprint.x0 + self.width * footprint.y0],
+                self.data[footprint.x1 + self.width * footprint.y0],
+                self.data[footprint.x0 + self.width * footprint.y1],
+                self.data[footprint.x1 + self.width * footprint.y1],
+            }, footprint.weight_x, footprint.weight_y);
+        }
+
         pub fn clear(self: *Self, value: T) void {
-            for (self.data) |*v| { v.* = value; }
+            @memset(self.data, value);
         }
         
         pub fn line(self: *Self, a: Vector2i, b: Vector2i, color: T) void {
@@ -217,3 +229,459 @@ pub fn Buffer2D(comptime T: type) type {
         }
     };
 }
+
+/// Defers the clearing of a `Buffer2D`. `clear` only flags its tiles of `tile_size` x `tile_size` pixels as pending, and a pending tile is
+/// filled with the clear value when it is first `prepare`d during the frame. `resolve` fills the tiles still pending (the ones nothing
+/// was drawn to), right before presenting the buffer. Touching the wrapped buffer directly is only valid for tiles which are not pending.
+pub fn LazyClearBuffer2D(comptime T: type) type {
+    return struct {
+
+        const Self = @This();
+
+        pub const tile_size = LazyClear.tile_size;
+
+        buffer: Buffer2D(T),
+        pending: Buffer2D(bool),
+        value: T,
+
+        pub fn init(allocator: std.mem.Allocator, buffer: Buffer2D(T)) !Self {
+            const tiles_x = try std.math.divCeil(usize, buffer.width, tile_size);
+            const tiles_y = try std.math.divCeil(usize, buffer.height, tile_size);
+            const pending = Buffer2D(bool).from(try allocator.alloc(bool, tiles_x * tiles_y), tiles_x);
+            @memset(pending.data, false);
+            return .{
+                .buffer = buffer,
+                .pending = pending,
+                .value = undefined,
+            };
+        }
+
+        pub fn deinit(self: *Self, allocator: std.mem.Allocator) void {
+            allocator.free(self.pending.data);
+        }
+
+        pub fn clear(self: *Self, value: T) void {
+            self.value = value;
+            @memset(self.pending.data, true);
+        }
+
+        /// fills the pending tiles overlapped by the area from `left`, `bottom` to `right`, `top` (exclusive)
+        pub fn prepare(self: Self, left: usize, bottom: usize, right: usize, top: usize) void {
+            if (right <= left or top <= bottom) return;
+            for (bottom / tile_size..(top - 1) / tile_size + 1) |tile_y| {
+                for (left / tile_size..(right - 1) / tile_size + 1) |tile_x| {
+                    const pending = self.pending.at(tile_x, tile_y);
+                    if (!pending.*) continue;
+                    self.fill_tile(tile_x, tile_y);
+                    pending.* = false;
+                }
+            }
+        }
+
+        /// fills every tile still pending
+        pub fn resolve(self: Self) void {
+            self.prepare(0, 0, self.buffer.width, self.buffer.height);
+        }
+
+        pub fn lazy_clear(self: *const Self) LazyClear {
+            return .{
+                .ptr = @ptrCast(self),
+                .prepare_fn = struct {
+                    fn prepare(ptr: *const anyopaque, left: usize, bottom: usize, right: usize, top: usize) void {
+                        const lazy_buffer: *const Self = @ptrCast(@alignCast(ptr));
+                        lazy_buffer.prepare(left, bottom, right, top);
+                    }
+                }.prepare,
+            };
+        }
+
+        fn fill_tile(self: Self, tile_x: usize, tile_y: usize) void {
+            const left = tile_x * tile_size;
+            const right = @min(left + tile_size, self.buffer.width);
+            const bottom = tile_y * tile_size;
+            const top = @min(bottom + tile_size, self.buffer.height);
+            for (bottom..top) |y| @memset(self.buffer.data[left + self.buffer.width * y .. right + self.buffer.width * y], self.value);
+        }
+    };
+}
+
+/// Type erased `LazyClearBuffer2D`, so that buffers of any type can be handed to a pipeline to be prepared before drawing to them
+pub const LazyClear = struct {
+    pub const tile_size = 32;
+
+    ptr: *const anyopaque,
+    prepare_fn: *const fn (ptr: *const anyopaque, left: usize, bottom: usize, right: usize, top: usize) void,
+
+    pub inline fn prepare(self: LazyClear, left: usize, bottom: usize, right: usize, top: usize) void {
+        self.prepare_fn(self.ptr, left, bottom, right, top);
+    }
+};
+
+test "LazyClearBuffer2D only fills the tiles that are used" {
+    const allocator = std.testing.allocator;
+    var data = [_]f32 { 0 } ** (70 * 40);
+    var lazy_buffer = try LazyClearBuffer2D(f32).init(allocator, Buffer2D(f32).from(&data, 70));
+    defer lazy_buffer.deinit(allocator);
+
+    lazy_buffer.clear(999999);
+    try std.testing.expectEqual(@as(f32, 0), data[0]);
+    lazy_buffer.lazy_clear().prepare(33, 1, 34, 2);
+    try std.testing.expectEqual(@as(f32, 0), lazy_buffer.buffer.get(0, 0));
+    try std.testing.expectEqual(@as(f32, 999999), lazy_buffer.buffer.get(32, 0));
+    try std.testing.expectEqual(@as(f32, 999999), lazy_buffer.buffer.get(63, 31));
+    try std.testing.expectEqual(@as(f32, 0), lazy_buffer.buffer.get(64, 0));
+    lazy_buffer.buffer.set(40, 10, 5);
+    lazy_buffer.resolve();
+    try std.testing.expectEqual(@as(f32, 5), lazy_buffer.buffer.get(40, 10));
+    for (data, 0..) |value, i| if (i != 40 + 70 * 10) try std.testing.expectEqual(@as(f32, 999999), value);
+}
+
+/// Same as a `Buffer2D` when sampling, but the texels are stored in square tiles of `tile_size` x `tile_size` texels, each tile being
+/// contiguous in memory, so that sampling along any direction (and not only along rows) mostly hits the same cache lines.
+/// Built once from a regular `Buffer2D` (say, right after loading the tga), which is then no longer needed.
+pub fn TiledBuffer2D(comptime T: type, comptime tile_size: usize) type {
+    if (!std.math.isPowerOfTwo(tile_size)) @compileError("tile_size must be a power of two");
+    return struct {
+
+        const Self = @This();
+        const tile_shift: std.math.Log2Int(usize) = @intCast(std.math.log2_int(usize, tile_size));
+        const tile_mask = tile_size - 1;
+
+        /// padded to a whole number of tiles
+        data: []T,
+        width: usize,
+        height: usize,
+        tiles_per_row: usize,
+
+        pub fn init(allocator: std.mem.Allocator, source: Buffer2D(T)) !Self {
+            const tiles_per_row = try std.math.divCeil(usize, source.width, tile_size);
+            const tiles_per_column = try std.math.divCeil(usize, source.height, tile_size);
+            const self = Self {
+                .data = try allocator.alloc(T, tiles_per_row * tiles_per_column * tile_size * tile_size),
+                .width = source.width,
+                .height = source.height,
+                .tiles_per_row = tiles_per_row,
+            };
+            // the padding repeats the last column and row, which is never sampled anyway
+            for (0..tiles_per_column * tile_size) |y| {
+                for (0..tiles_per_row * tile_size) |x| {
+                    self.data[self.index(x, y)] = source.get(@min(x, source.width - 1), @min(y, source.height - 1));
+                }
+            }
+            return self;
+        }
+
+        pub fn deinit(self: Self, allocator: std.mem.Allocator) void {
+            allocator.free(self.data);
+        }
+
+        inline fn index(self: Self, x: usize, y: usize) usize {
+            const tile = (y >> tile_shift) * self.tiles_per_row + (x >> tile_shift);
+            return (tile << (tile_shift * 2)) | ((y & tile_mask) << tile_shift) | (x & tile_mask);
+        }
+
+        pub inline fn set(self: Self, x: usize, y: usize, item: T) void {
+            self.data[self.index(x, y)] = item;
+        }
+
+        pub inline fn get(self: Self, x: usize, y: usize) T {
+            return self.data[self.index(x, y)];
+        }
+
+        /// set `point_is_normalized` to true if the `point` is normalized to the range [0..1]
+        pub fn point_sample(self: Self, comptime point_is_normalized: bool, point: Vector2f) T {
+            const tx = if (point_is_normalized) point.x * @as(f32, @floatFromInt(self.width)) else point.x;
+            const ty = if (point_is_normalized) point.y * @as(f32, @floatFromInt(self.height)) else point.y;
+            const x: usize = @intFromFloat( std.math.clamp(tx, 0, @as(f32, @floatFromInt(self.width-1)) ) );
+            const y: usize = @intFromFloat( std.math.clamp(ty, 0, @as(f32, @floatFromInt(self.height-1)) ) );
+            return self.get(x, y);
+        }
+
+        /// Same filtering as `Buffer2D.bilinear_sample`. On the borders the clamped texels are the same, so no special cases are needed
+        pub fn bilinear_sample(self: Self, comptime point_is_normalized: bool, point: Vector2f) T {
+            const tx = if (point_is_normalized) point.x * @as(f32, @floatFromInt(self.width)) else point.x;
+            const ty = if (point_is_normalized) point.y * @as(f32, @floatFromInt(self.height)) else point.y;
+
+            const x_min: usize = @intFromFloat( @max( @floor(tx-0.5), 0) );
+            const x_max: usize = @intFromFloat( @min( @floor(tx+0.5), @as(f32, @floatFromInt(self.width-1))) );
+            const y_min: usize = @intFromFloat( @max( @floor(ty-0.5), 0) );
+            const y_max: usize = @intFromFloat( @min( @floor(ty+0.5), @as(f32, @floatFromInt(self.height-1))) );
+
+            const color_bottom_left = self.get(x_min, y_min);
+            const color_bottom_right = self.get(x_max, y_min);
+            const color_top_left = self.get(x_min, y_max);
+            const color_top_right = self.get(x_max, y_max);
+
+            const weight_x: f32 = tx - (@floor(tx-0.5) + 0.5);
+            const weight_y: f32 = ty - (@floor(ty-0.5) + 0.5);
+
+            const interpolated_color_1 = color_bottom_left.scale_raw(1 - weight_x).add_raw(color_bottom_right.scale_raw(weight_x));
+            const interpolated_color_2 = color_top_left.scale_raw(1 - weight_x).add_raw(color_top_right.scale_raw(weight_x));
+            return interpolated_color_1.scale_raw(1 - weight_y).add_raw(interpolated_color_2.scale_raw(weight_y));
+        }
+
+        /// see `Buffer2D.bilinear_sample_fixed_point`
+        pub fn bilinear_sample_fixed_point(self: Self, comptime point_is_normalized: bool, point: Vector2f) T {
+            const footprint = BilinearFootprint.from(point_is_normalized, point, self.width, self.height);
+            return bilinear_blend_fixed_point(T, .{
+                self.get(footprint.x0, footprint.y0),
+                self.get(footprint.x1, footprint.y0),
+                self.get(footprint.x0, footprint.y1),
+                self.get(footprint.x1, footprint.y1),
+            }, footprint.weight_x, footprint.weight_y);
+        }
+    };
+}
+
+/// The 2x2 texels around a point (clamped to the texture) and the 8.8 fixed point weights of the right and top ones
+const BilinearFootprint = struct {
+    x0: usize,
+    x1: usize,
+    y0: usize,
+    y1: usize,
+    weight_x: u16,
+    weight_y: u16,
+
+    inline fn from(comptime point_is_normalized: bool, point: Vector2f, width: usize, height: usize) BilinearFootprint {
+        const tx = if (point_is_normalized) point.x * @as(f32, @floatFromInt(width)) else point.x;
+        const ty = if (point_is_normalized) point.y * @as(f32, @floatFromInt(height)) else point.y;
+        // texel centers are at .5, so move half a texel (128 in 8.8) to have the left/bottom texel in the integer part
+        const fx: i32 = @as(i32, @intFromFloat(@floor(std.math.clamp(tx, -1, @as(f32, @floatFromInt(width + 1))) * 256))) - 128;
+        const fy: i32 = @as(i32, @intFromFloat(@floor(std.math.clamp(ty, -1, @as(f32, @floatFromInt(height + 1))) * 256))) - 128;
+        const max_x: i32 = @intCast(width - 1);
+        const max_y: i32 = @intCast(height - 1);
+        return .{
+            .x0 = @intCast(std.math.clamp(fx >> 8, 0, max_x)),
+            .x1 = @intCast(std.math.clamp((fx >> 8) + 1, 0, max_x)),
+            .y0 = @intCast(std.math.clamp(fy >> 8, 0, max_y)),
+            .y1 = @intCast(std.math.clamp((fy >> 8) + 1, 0, max_y)),
+            .weight_x = @intCast(fx & 0xff),
+            .weight_y = @intCast(fy & 0xff),
+        };
+    }
+};
+
+/// Blends the texels bottom left, bottom right, top left and top right, with every channel of the 4 of them in a lane of a single `@Vector(16, u16)`.
+/// The weights are in 8.8 and add up to exactly 256, so no lane can overflow (255 * 256 + 128 < 65536)
+inline fn bilinear_blend_fixed_point(comptime T: type, texels: [4]T, weight_x: u16, weight_y: u16) T {
+    const fields = @typeInfo(T).Struct.fields;
+    comptime {
+        if (fields.len != 3 and fields.len != 4) @compileError("bilinear_sample_fixed_point needs a pixel type of 3 or 4 u8 channels");
+        for (fields) |field| if (field.type != u8) @compileError("bilinear_sample_fixed_point needs a pixel type of 3 or 4 u8 channels");
+    }
+    const inverse_x = 256 - weight_x;
+    const inverse_y = 256 - weight_y;
+    const weight_bottom_left: u16 = @intCast((@as(u32, inverse_x) * inverse_y) >> 8);
+    const weight_bottom_right: u16 = @intCast((@as(u32, weight_x) * inverse_y) >> 8);
+    const weight_top_left: u16 = @intCast((@as(u32, inverse_x) * weight_y) >> 8);
+    const weight_top_right: u16 = 256 - weight_bottom_left - weight_bottom_right - weight_top_left;
+
+    var channels: [16]u16 = .{0} ** 16;
+    inline for (texels, 0..) |texel, t| {
+        inline for (fields, 0..) |field, c| channels[t * 4 + c] = @field(texel, field.name);
+    }
+    const weights = @Vector(16, u16) {
+        weight_bottom_left, weight_bottom_left, weight_bottom_left, weight_bottom_left,
+        weight_bottom_right, weight_bottom_right, weight_bottom_right, weight_bottom_right,
+        weight_top_left, weight_top_left, weight_top_left, weight_top_left,
+        weight_top_right, weight_top_right, weight_top_right, weight_top_right,
+    };
+    const weighted = @as(@Vector(16, u16), channels) * weights;
+    const sum =
+        @shuffle(u16, weighted, undefined, @Vector(4, i32) { 0, 1, 2, 3 }) +
+        @shuffle(u16, weighted, undefined, @Vector(4, i32) { 4, 5, 6, 7 }) +
+        @shuffle(u16, weighted, undefined, @Vector(4, i32) { 8, 9, 10, 11 }) +
+        @shuffle(u16, weighted, undefined, @Vector(4, i32) { 12, 13, 14, 15 });
+    const result_channels: [4]u16 = (sum + @as(@Vector(4, u16), @splat(128))) >> @splat(8);
+    var result: T = undefined;
+    inline for (fields, 0..) |field, c| @field(result, field.name) = @intCast(result_channels[c]);
+    return result;
+}
+
+test "TiledBuffer2D samples the same texels as the Buffer2D it was built from" {
+    const RGBA = @import("pixels.zig").RGBA;
+    const allocator = std.testing.allocator;
+    var texture_data: [13 * 7]RGBA = undefined;
+    for (&texture_data, 0..) |*texel, i| texel.* = RGBA.make(@intCast(i), @intCast(i / 2), 0, 255);
+    const texture = Buffer2D(RGBA).from(&texture_data, 13);
+    const tiled_texture = try TiledBuffer2D(RGBA, 4).init(allocator, texture);
+    defer tiled_texture.deinit(allocator);
+
+    for (0..texture.height) |y| {
+        for (0..texture.width) |x| try std.testing.expectEqual(texture.get(x, y), tiled_texture.get(x, y));
+    }
+    const point = Vector2f { .x = 0.37, .y = 0.81 };
+    try std.testing.expectEqual(texture.point_sample(true, point), tiled_texture.point_sample(true, point));
+    try std.testing.expectEqual(texture.bilinear_sample(true, point), tiled_texture.bilinear_sample(true, point));
+}
+
+test "bilinear_sample_fixed_point blends the 4 nearest texels and clamps the borders" {
+    const RGB = @import("pixels.zig").RGB;
+    const texture_data = [4]RGB {
+        .{ .r = 0, .g = 0, .b = 0 }, .{ .r = 200, .g = 100, .b = 0 },
+        .{ .r = 100, .g = 0, .b = 50 }, .{ .r = 255, .g = 255, .b = 255 },
+    };
+    var data = texture_data;
+    const texture = Buffer2D(RGB).from(&data, 2);
+    // right between the 4 texels
+    try std.testing.expectEqual(RGB { .r = 139, .g = 89, .b = 76 }, texture.bilinear_sample_fixed_point(true, .{ .x = 0.5, .y = 0.5 }));
+    // outside of the texture the nearest texel is returned
+    try std.testing.expectEqual(texture_data[0], texture.bilinear_sample_fixed_point(true, .{ .x = -0.5, .y = -0.5 }));
+    try std.testing.expectEqual(texture_data[3], texture.bilinear_sample_fixed_point(true, .{ .x = 1.5, .y = 1.5 }));
+}
+
+/// A texture together with its mip levels, each half the size of the previous one, down to 1x1.
+/// Level 0 is the original texture (not copied), the rest are generated (and owned) by `init`.
+/// Sampling a level that roughly matches the screen size of the texture keeps texel reads close together when it is minified.
+pub fn MipChain(comptime T: type) type {
+    return struct {
+
+        const Self = @This();
+
+        pub const max_levels = 16;
+
+        /// how each texel of a level is calculated from the previous level
+        pub const Filter = enum {
+            /// the mean of the 2x2 texels it covers
+            box,
+            /// 4x4 texels weighted 1-3-3-1 on each axis, which is smoother but slower to build
+            tent,
+        };
+
+        pub const Sampling = enum {
+            /// `point_sample` of the nearest level
+            point,
+            /// `bilinear_sample` of the nearest level
+            bilinear,
+            /// `bilinear_sample` of the two nearest levels, blended
+            trilinear,
+        };
+
+        levels: [max_levels]Buffer2D(T),
+        level_count: usize,
+
+        pub fn init(allocator: std.mem.Allocator, texture: Buffer2D(T), comptime filter: Filter) !Self {
+            var self: Self = undefined;
+            self.levels[0] = texture;
+            self.level_count = 1;
+            errdefer self.deinit(allocator);
+            while (self.level_count < max_levels) {
+                const previous = self.levels[self.level_count - 1];
+                if (previous.width == 1 and previous.height == 1) break;
+                const width = @max(1, previous.width / 2);
+                const height = @max(1, previous.height / 2);
+                const level = Buffer2D(T).from(try allocator.alloc(T, width * height), width);
+                downsample(filter, previous, level);
+                self.levels[self.level_count] = level;
+                self.level_count += 1;
+            }
+            return self;
+        }
+
+        /// frees the generated levels, the original texture is left alone
+        pub fn deinit(self: *Self, allocator: std.mem.Allocator) void {
+            for (self.levels[1..self.level_count]) |level| allocator.free(level.data);
+            self.level_count = 1;
+        }
+
+        /// The level (fractional, for `trilinear`) at which a texel is roughly the size of a pixel on screen.
+        /// `uv_per_pixel` is how much of the normalized texture a single pixel covers, along one axis.
+        pub fn level_of_detail(self: Self, uv_per_pixel: f32) f32 {
+            const size: f32 = @floatFromInt(@max(self.levels[0].width, self.levels[0].height));
+            const texels_per_pixel = uv_per_pixel * size;
+            if (texels_per_pixel <= 1) return 0;
+            return @min(std.math.log2(texels_per_pixel), @as(f32, @floatFromInt(self.level_count - 1)));
+        }
+
+        /// `point` is normalized to the range [0..1]
+        pub fn sample(self: Self, comptime sampling: Sampling, point: Vector2f, uv_per_pixel: f32) T {
+            const lod = self.level_of_detail(uv_per_pixel);
+            switch (sampling) {
+                .point => return self.levels[@intFromFloat(@round(lod))].point_sample(true, point),
+                .bilinear => return self.levels[@intFromFloat(@round(lod))].bilinear_sample(true, point),
+                .trilinear => {
+                    const lower: usize = @intFromFloat(@floor(lod));
+                    const weight = lod - @floor(lod);
+                    const lower_color = self.levels[lower].bilinear_sample(true, point);
+                    if (weight == 0 or lower + 1 == self.level_count) return lower_color;
+                    const upper_color = self.levels[lower + 1].bilinear_sample(true, point);
+                    return weighted_sum(T, &.{ lower_color, upper_color }, &.{ 1 - weight, weight });
+                },
+            }
+        }
+
+        fn downsample(comptime filter: Filter, source: Buffer2D(T), destination: Buffer2D(T)) void {
+            const max_x: isize = @intCast(source.width - 1);
+            const max_y: isize = @intCast(source.height - 1);
+            for (0..destination.height) |y| {
+                for (0..destination.width) |x| {
+                    const texel = switch (filter) {
+                        .box => blk: {
+                            const x0 = @min(x * 2, source.width - 1);
+                            const x1 = @min(x * 2 + 1, source.width - 1);
+                            const y0 = @min(y * 2, source.height - 1);
+                            const y1 = @min(y * 2 + 1, source.height - 1);
+                            break :blk weighted_sum(T,
+                                &.{ source.get(x0, y0), source.get(x1, y0), source.get(x0, y1), source.get(x1, y1) },
+                                &.{ 0.25, 0.25, 0.25, 0.25 }
+                            );
+                        },
+                        .tent => blk: {
+                            const weights = [4]f32 { 1.0/8.0, 3.0/8.0, 3.0/8.0, 1.0/8.0 };
+                            var texels: [16]T = undefined;
+                            var texel_weights: [16]f32 = undefined;
+                            for (0..4) |j| {
+                                const sy: usize = @intCast(std.math.clamp(@as(isize, @intCast(y * 2 + j)) - 1, 0, max_y));
+                                for (0..4) |i| {
+                                    const sx: usize = @intCast(std.math.clamp(@as(isize, @intCast(x * 2 + i)) - 1, 0, max_x));
+                                    texels[i + j * 4] = source.get(sx, sy);
+                                    texel_weights[i + j * 4] = weights[i] * weights[j];
+                                }
+                            }
+                            break :blk weighted_sum(T, &texels, &texel_weights);
+                        },
+                    };
+                    destination.set(x, y, texel);
+                }
+            }
+        }
+    };
+}
+
+/// `sum(texels[i] * weights[i])` calculated field by field in f32 and rounded back, for any struct of ints and floats
+fn weighted_sum(comptime T: type, texels: []const T, weights: []const f32) T {
+    var result: T = undefined;
+    inline for (@typeInfo(T).Struct.fields) |field| {
+        var sum: f32 = 0;
+        for (texels, weights) |texel, weight| {
+            const value = @field(texel, field.name);
+            sum += weight * switch (@typeInfo(field.type)) {
+                .Int => @as(f32, @floatFromInt(value)),
+                .Float => @as(f32, @floatCast(value)),
+                else => @compileError("field " ++ field.name ++ " is neither a Float or Int so it cant be filtered!"),
+            };
+        }
+        @field(result, field.name) = switch (@typeInfo(field.type)) {
+            .Int => @intFromFloat(std.math.clamp(@round(sum), std.math.minInt(field.type), std.math.maxInt(field.type))),
+            .Float => @floatCast(sum),
+            else => unreachable,
+        };
+    }
+    return result;
+}
+
+test "MipChain levels halve down to 1x1 and keep the mean color" {
+    const RGBA = @import("pixels.zig").RGBA;
+    const allocator = std.testing.allocator;
+    var texture_data: [8 * 4]RGBA = undefined;
+    for (&texture_data, 0..) |*texel, i| texel.* = if (i % 2 == 0) RGBA { .r = 0, .g = 0, .b = 0, .a = 255 } else RGBA { .r = 200, .g = 100, .b = 50, .a = 255 };
+    var mip_chain = try MipChain(RGBA).init(allocator, Buffer2D(RGBA).from(&texture_data, 8), .box);
+    defer mip_chain.deinit(allocator);
+
+    try std.testing.expectEqual(@as(usize, 4), mip_chain.level_count);
+    try std.testing.expectEqual(@as(usize, 1), mip_chain.levels[3].width);
+    try std.testing.expectEqual(@as(usize, 1), mip_chain.levels[3].height);
+    try std.testing.expectEqual(RGBA { .r = 100, .g = 50, .b = 25, .a = 255 }, mip_chain.levels[1].get(0, 0));
+    try std.testing.expectEqual(@as(f32, 0), mip_chain.level_of_detail(1.0 / 8.0));
+    try std.testing.expectEqual(@as(f32, 3), mip_chain.level_of_detail(1));
+}
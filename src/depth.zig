@@ -0,0 +1,143 @@
+const std = @import("std");
+const Buffer2D = @import("buffer.zig").Buffer2D;
+
+/// Keeps the maximum depth of every 8x8 block (and optionally of every 64x64 block) of a depth buffer, so that the pipeline
+/// can reject whole blocks of a triangle (or whole triangles) which are behind everything already drawn, before doing any per pixel work.
+///
+/// The stored maximums are always greater or equal than the real ones, since depth values only ever get smaller (closer) between clears.
+/// When a block is drawn to it is marked as dirty and its maximum is only recalculated when a test against the old value is not enough to reject.
+///
+/// Use `clear` rather than clearing the wrapped depth buffer directly, since both need to be reset.
+pub const HierarchicalDepthBuffer = struct {
+
+    pub const block_size = 8;
+    pub const coarse_block_size = 64;
+    const blocks_per_coarse_block = coarse_block_size / block_size;
+
+    const Block = struct {
+        max: f32,
+        dirty: bool,
+    };
+
+    depth_buffer: Buffer2D(f32),
+    blocks: Buffer2D(Block),
+    coarse_blocks: ?Buffer2D(Block),
+
+    pub fn init(allocator: std.mem.Allocator, depth_buffer: Buffer2D(f32), with_coarse_level: bool) !HierarchicalDepthBuffer {
+        const blocks_x = try std.math.divCeil(usize, depth_buffer.width, block_size);
+        const blocks_y = try std.math.divCeil(usize, depth_buffer.height, block_size);
+        const blocks = Buffer2D(Block).from(try allocator.alloc(Block, blocks_x * blocks_y), blocks_x);
+        const coarse_blocks: ?Buffer2D(Block) = if (with_coarse_level) blk: {
+            const coarse_blocks_x = try std.math.divCeil(usize, depth_buffer.width, coarse_block_size);
+            const coarse_blocks_y = try std.math.divCeil(usize, depth_buffer.height, coarse_block_size);
+            break :blk Buffer2D(Block).from(try allocator.alloc(Block, coarse_blocks_x * coarse_blocks_y), coarse_blocks_x);
+        } else null;
+        return .{
+            .depth_buffer = depth_buffer,
+            .blocks = blocks,
+            .coarse_blocks = coarse_blocks,
+        };
+    }
+
+    pub fn deinit(self: *HierarchicalDepthBuffer, allocator: std.mem.Allocator) void {
+        if (self.coarse_blocks) |coarse_blocks| allocator.free(coarse_blocks.data);
+        allocator.free(self.blocks.data);
+    }
+
+    /// clears both the depth buffer and the blocks
+    pub fn clear(self: *HierarchicalDepthBuffer, value: f32) void {
+        self.depth_buffer.clear(value);
+        self.blocks.clear(.{ .max = value, .dirty = false });
+        if (self.coarse_blocks) |*coarse_blocks| coarse_blocks.clear(.{ .max = value, .dirty = false });
+    }
+
+    /// true if every pixel of the 8x8 block at `block_x`, `block_y` is closer than `nearest_depth`
+    pub fn is_occluded(self: *HierarchicalDepthBuffer, block_x: usize, block_y: usize, nearest_depth: f32) bool {
+        if (self.coarse_blocks) |coarse_blocks| {
+            const coarse_block = coarse_blocks.at(block_x / blocks_per_coarse_block, block_y / blocks_per_coarse_block);
+            if (coarse_block.max < nearest_depth) return true;
+            if (coarse_block.dirty) {
+                self.refresh_coarse_block(block_x / blocks_per_coarse_block, block_y / blocks_per_coarse_block);
+                if (coarse_block.max < nearest_depth) return true;
+            }
+        }
+        const block = self.blocks.at(block_x, block_y);
+        if (block.max < nearest_depth) return true;
+        if (block.dirty) {
+            self.refresh_block(block_x, block_y);
+            return block.max < nearest_depth;
+        }
+        return false;
+    }
+
+    /// lets the block know that its depth values might have changed
+    pub inline fn mark_dirty(self: *HierarchicalDepthBuffer, block_x: usize, block_y: usize) void {
+        self.blocks.at(block_x, block_y).dirty = true;
+    }
+
+    fn refresh_block(self: *HierarchicalDepthBuffer, block_x: usize, block_y: usize) void {
+        const left = block_x * block_size;
+        const bottom = block_y * block_size;
+        const right = @min(left + block_size, self.depth_buffer.width);
+        const top = @min(bottom + block_size, self.depth_buffer.height);
+        var max: f32 = -std.math.inf(f32);
+        if (right - left == block_size) {
+            var max_row: @Vector(block_size, f32) = @splat(max);
+            for (bottom..top) |y| {
+                const row: @Vector(block_size, f32) = self.depth_buffer.data[left + self.depth_buffer.width * y ..][0..block_size].*;
+                max_row = @max(max_row, row);
+            }
+            max = @reduce(.Max, max_row);
+        }
+        else {
+            for (bottom..top) |y| {
+                for (left..right) |x| max = @max(max, self.depth_buffer.get(x, y));
+            }
+        }
+        const block = self.blocks.at(block_x, block_y);
+        block.max = max;
+        block.dirty = false;
+        // the coarse block can now be tightened too
+        if (self.coarse_blocks) |coarse_blocks| coarse_blocks.at(block_x / blocks_per_coarse_block, block_y / blocks_per_coarse_block).dirty = true;
+    }
+
+    /// the coarse blocks are calculated from the (maybe not up to date, but never too small) maximums of the blocks they contain
+    fn refresh_coarse_block(self: *HierarchicalDepthBuffer, coarse_block_x: usize, coarse_block_y: usize) void {
+        const left = coarse_block_x * blocks_per_coarse_block;
+        const bottom = coarse_block_y * blocks_per_coarse_block;
+        const right = @min(left + blocks_per_coarse_block, self.blocks.width);
+        const top = @min(bottom + blocks_per_coarse_block, self.blocks.height);
+        var max: f32 = -std.math.inf(f32);
+        for (bottom..top) |y| {
+            for (left..right) |x| max = @max(max, self.blocks.get(x, y).max);
+        }
+        const coarse_block = self.coarse_blocks.?.at(coarse_block_x, coarse_block_y);
+        coarse_block.max = max;
+        coarse_block.dirty = false;
+    }
+};
+
+test "HierarchicalDepthBuffer only rejects what is behind everything" {
+    const allocator = std.testing.allocator;
+    const depth_data = try allocator.alloc(f32, 128 * 64);
+    defer allocator.free(depth_data);
+    var hierarchical_depth_buffer = try HierarchicalDepthBuffer.init(allocator, Buffer2D(f32).from(depth_data, 128), true);
+    defer hierarchical_depth_buffer.deinit(allocator);
+
+    hierarchical_depth_buffer.clear(999999);
+    try std.testing.expect(!hierarchical_depth_buffer.is_occluded(0, 0, 10));
+
+    // fill the first block with something close, except for a single pixel which is left far away
+    for (0..8) |y| {
+        for (0..8) |x| {
+            if (x == 7 and y == 7) continue;
+            hierarchical_depth_buffer.depth_buffer.set(x, y, 1);
+        }
+    }
+    hierarchical_depth_buffer.mark_dirty(0, 0);
+    try std.testing.expect(!hierarchical_depth_buffer.is_occluded(0, 0, 10));
+    hierarchical_depth_buffer.depth_buffer.set(7, 7, 5);
+    hierarchical_depth_buffer.mark_dirty(0, 0);
+    try std.testing.expect(hierarchical_depth_buffer.is_occluded(0, 0, 10));
+    try std.testing.expect(!hierarchical_depth_buffer.is_occluded(1, 0, 10));
+}
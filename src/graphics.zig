@@ -7,21 +7,96 @@ const Vector4f = math.Vector4f;
 const M44 = math.M44;
 const M33 = math.M33;
 const Plane = math.Plane;
-const Frustum = math.Frustum;
+const BoundingVolume = math.BoundingVolume;
 const Buffer2D = @import("buffer.zig").Buffer2D;
+const LazyClear = @import("buffer.zig").LazyClear;
+const pixels = @import("pixels.zig");
+const BlendMode = pixels.BlendMode;
+const HierarchicalDepthBuffer = @import("depth.zig").HierarchicalDepthBuffer;
 
 pub const GraphicsPipelineConfiguration = struct {
+    /// same as `blend_mode = .alpha`
     blend_with_background: bool = false,
+    /// how the shaded pixels are written over the pixel buffer. Can't be used together with `blend_with_background`
+    blend_mode: ?BlendMode = null,
     use_index_buffer_auto: bool = false,
     use_index_buffer: bool = false,
+    /// Keeps the last `vertex_cache_size` shaded vertices of the draw call, so that faces sharing an index don't run the vertex shader again for it.
+    /// Requires `use_index_buffer` or `use_index_buffer_auto`
+    use_vertex_cache: bool = false,
+    vertex_cache_size: usize = 32,
     do_triangle_clipping: bool = false,
+    /// How far past the sides of the view volume a vertex can be (in multiples of the viewport, 1 being no guard band) before `do_triangle_clipping`
+    /// actually clips against the sides. Triangles inside of the guard band are left to the rasterizer, so only the near and far planes need real clipping
+    clipping_guard_band: f32 = 4,
     do_depth_testing: bool = false,
+    /// the type of `requirements.depth_buffer`, see `DepthFormat`
+    depth_format: DepthFormat = .float32,
+    /// Closer depths are bigger rather than smaller. Use together with `M44.perspective_projection_reversed_z`, and clear the depth buffer
+    /// to `depth_clear_value()`. Spreads the precision of the unorm formats much more evenly over the distance
+    reversed_z: bool = false,
+    /// Before rasterizing, tests the nearest depth of the triangle against `requirements.hierarchical_depth_buffer`, skipping the 8x8 blocks
+    /// (or the whole triangle) which are behind what is already drawn. Requires `do_depth_testing`, and the hierarchical depth buffer must wrap `depth_buffer`
+    do_hierarchical_depth_testing: bool = false,
     do_perspective_correct_interpolation: bool = false,
     do_scissoring: bool = false,
     use_triangle_2: bool = false,
+    /// Uses the incremental edge function rasterizer which works on 8 pixels at a time. Takes precedence over `use_triangle_2`
+    use_triangle_simd: bool = false,
+    /// Uses the integer rasterizer which snaps vertices to a subpixel grid and follows the top-left fill rule, so pixels on shared edges are drawn exactly once.
+    /// Takes precedence over `use_triangle_2`
+    use_triangle_fixed_point: bool = false,
+    /// fractional bits of the subpixel grid used by `use_triangle_fixed_point`. The default of 4 is a 28.4 fixed point format.
+    /// At most `max_subpixel_bits`, past that the i64 edge functions could overflow
+    subpixel_bits: u5 = 4,
+    /// Bins the triangles into screen tiles and rasterizes the tiles in parallel on `requirements.thread_pool`.
+    /// Requires `thread_pool` and an `allocator` for the per-draw triangle and tile lists.
+    use_multithreading: bool = false,
+    /// size in pixels of the side of the square tiles used when `use_multithreading`
+    multithreading_tile_size: usize = 64,
+    /// Deferred shading. Rasterizing only writes the depth and which triangle (and where in it) covers each pixel to `requirements.visibility_buffer`,
+    /// and once every face is rasterized the fragment shader runs exactly once per covered pixel. Requires `do_depth_testing`, and an `allocator` for the triangles of the draw call.
+    /// The visibility buffer must be cleared to `VisibilityBufferEntry.empty` once when created, `render` leaves it cleared when it returns
+    use_visibility_buffer: bool = false,
+    /// Before rasterizing, writes how much of the normalized texture a pixel covers (the square root of the uv area over the screen area of the triangle)
+    /// to an f32 field of every invariant, so that the fragment shader can pick a level of a `MipChain`. The uv field must be a `Vector2f`
+    texture_level_of_detail: ?TextureLevelOfDetail = null,
+    /// Before rasterizing a triangle, prepares the tiles it overlaps of every `LazyClearBuffer2D` in `requirements.lazy_clears`
+    /// (usually the ones wrapping the pixel buffer and the depth buffer), so that they only get cleared where something is drawn.
+    /// Not compatible with `do_hierarchical_depth_testing`, which reads whole blocks of the depth buffer
+    use_lazy_clear: bool = false,
     /// for debugging purposes
     trace: bool = false,
     
+    /// The edge functions of `use_triangle_fixed_point` multiply two subpixel coordinates, so with 8 bits of subpixels they stay well
+    /// inside of an i64 for coordinates of up to about 2^22 pixels, guard band included
+    pub const max_subpixel_bits = 8;
+
+    pub const TextureLevelOfDetail = struct {
+        /// name of the `Vector2f` invariant field with the texture coordinates
+        uv_field: []const u8,
+        /// name of the `f32` invariant field where the uv per pixel is written
+        uv_per_pixel_field: []const u8,
+    };
+
+    /// `blend_mode` if set, otherwise `alpha` or `opaque` depending on `blend_with_background`
+    pub fn effective_blend_mode(comptime self: GraphicsPipelineConfiguration) BlendMode {
+        if (self.blend_mode) |mode| {
+            if (self.blend_with_background) @compileError("Only one option can be active: `blend_mode`, or `blend_with_background`");
+            return mode;
+        }
+        return if (self.blend_with_background) .alpha else .@"opaque";
+    }
+
+    /// the value to clear the depth buffer to, which is the farthest possible depth
+    pub fn depth_clear_value(comptime self: GraphicsPipelineConfiguration) self.depth_format.Type() {
+        if (self.reversed_z) return 0;
+        return switch (self.depth_format) {
+            .float32 => 999999,
+            .unorm16, .unorm24 => self.depth_format.max_value(),
+        };
+    }
+
     /// returns a comptime tpye (an struct, basically) which needs to be filled, and passed as a value to the render pipeline when calling `render`
     pub fn Requirements(comptime self: GraphicsPipelineConfiguration) type {
         var fields: []const std.builtin.Type.StructField = &[_]std.builtin.Type.StructField {
@@ -50,10 +125,23 @@ pub const GraphicsPipelineConfiguration = struct {
                 .default_value = null,
                 .is_comptime = false,
                 .name = "depth_buffer",
-                .type = Buffer2D(f32),
+                .type = Buffer2D(self.depth_format.Type()),
                 .alignment = @alignOf([]f32)
             }
         };
+        if (self.do_hierarchical_depth_testing) {
+            if (!self.do_depth_testing) @compileError("`do_hierarchical_depth_testing` requires `do_depth_testing`");
+            if (self.depth_format != .float32 or self.reversed_z) @compileError("`do_hierarchical_depth_testing` only supports a `float32` depth format without `reversed_z`");
+            fields = fields ++ [_]std.builtin.Type.StructField {
+                std.builtin.Type.StructField {
+                    .default_value = null,
+                    .is_comptime = false,
+                    .name = "hierarchical_depth_buffer",
+                    .type = *HierarchicalDepthBuffer,
+                    .alignment = @alignOf(*HierarchicalDepthBuffer)
+                }
+            };
+        }
         if (self.do_scissoring) fields = fields ++ [_]std.builtin.Type.StructField {
                 std.builtin.Type.StructField {
                 .default_value = null,
@@ -63,6 +151,49 @@ pub const GraphicsPipelineConfiguration = struct {
                 .alignment = @alignOf(Vector4f)
             }
         };
+        if (self.use_multithreading) fields = fields ++ [_]std.builtin.Type.StructField {
+            std.builtin.Type.StructField {
+                .default_value = null,
+                .is_comptime = false,
+                .name = "thread_pool",
+                .type = *std.Thread.Pool,
+                .alignment = @alignOf(*std.Thread.Pool)
+            },
+        };
+        if (self.use_lazy_clear) {
+            if (self.do_hierarchical_depth_testing) @compileError("Only one option can be active: `use_lazy_clear`, or `do_hierarchical_depth_testing`");
+            fields = fields ++ [_]std.builtin.Type.StructField {
+                std.builtin.Type.StructField {
+                    .default_value = null,
+                    .is_comptime = false,
+                    .name = "lazy_clears",
+                    .type = []const LazyClear,
+                    .alignment = @alignOf([]const LazyClear)
+                }
+            };
+        }
+        if (self.use_visibility_buffer) {
+            if (!self.do_depth_testing) @compileError("`use_visibility_buffer` requires `do_depth_testing`");
+            if (self.effective_blend_mode() != .@"opaque") @compileError("Only one option can be active: `use_visibility_buffer`, or blending (`blend_with_background` or `blend_mode`)");
+            fields = fields ++ [_]std.builtin.Type.StructField {
+                std.builtin.Type.StructField {
+                    .default_value = null,
+                    .is_comptime = false,
+                    .name = "visibility_buffer",
+                    .type = Buffer2D(VisibilityBufferEntry),
+                    .alignment = @alignOf([]VisibilityBufferEntry)
+                }
+            };
+        }
+        if (self.use_multithreading or self.use_visibility_buffer) fields = fields ++ [_]std.builtin.Type.StructField {
+            std.builtin.Type.StructField {
+                .default_value = null,
+                .is_comptime = false,
+                .name = "allocator",
+                .type = std.mem.Allocator,
+                .alignment = @alignOf(std.mem.Allocator)
+            },
+        };
         // TODO what exactly should I do with declarations?
         // according to the compiler, when I put any declaration whatsoever I ger `error: reified structs must have no decls`
         // not sure what that means
@@ -81,6 +212,56 @@ pub const GraphicsPipelineConfiguration = struct {
     }
 };
 
+/// How `do_depth_testing` stores depth. The unorm formats map depths in [0, 1] (as produced by the projection matrices in `M44`) to their
+/// whole integer range, so the depth test and the writes are integer operations on half (or three quarters of) the memory of `float32`
+pub const DepthFormat = enum {
+    /// any range of depths
+    float32,
+    unorm16,
+    /// stored as `u32`, of which only the lower 24 bits are used
+    unorm24,
+
+    pub fn Type(comptime self: DepthFormat) type {
+        return switch (self) {
+            .float32 => f32,
+            .unorm16 => u16,
+            .unorm24 => u32,
+        };
+    }
+
+    /// `z` as stored in a depth buffer of this format. The unorm formats clamp it to [0, 1]
+    pub inline fn encode(comptime self: DepthFormat, z: f32) self.Type() {
+        return switch (self) {
+            .float32 => z,
+            .unorm16, .unorm24 => @intFromFloat(@round(std.math.clamp(z, 0, 1) * comptime @as(f32, @floatFromInt(self.max_value())))),
+        };
+    }
+
+    pub fn max_value(comptime self: DepthFormat) comptime_int {
+        return switch (self) {
+            .float32 => @compileError("`float32` has no max value"),
+            .unorm16 => std.math.maxInt(u16),
+            .unorm24 => std.math.maxInt(u24),
+        };
+    }
+};
+
+/// true where the encoded depth `z` is at least as close as the `stored` one, closer depths being smaller unless `reversed_z`.
+/// The depth test of `do_depth_testing`, shared with anything else drawing to the same depth buffer. Works on both single values and vectors
+pub inline fn depth_test_passes(comptime reversed_z: bool, stored: anytype, z: @TypeOf(stored)) @TypeOf(stored >= z) {
+    return if (reversed_z) stored <= z else stored >= z;
+}
+
+/// What `use_visibility_buffer` stores for every pixel: the triangle that covers it (in the order in which they were emitted during the draw call)
+/// and the barycentric coordinates `u` and `v` of the pixel inside of that triangle
+pub const VisibilityBufferEntry = struct {
+    triangle_id: u32,
+    u: f32,
+    v: f32,
+
+    pub const empty = VisibilityBufferEntry { .triangle_id = std.math.maxInt(u32), .u = 0, .v = 0 };
+};
+
 pub fn GraphicsPipeline(
     // The output pixel type
     comptime final_color_type: type,
@@ -94,272 +275,634 @@ pub fn GraphicsPipeline(
     return struct {
 
         pub fn render(pixel_buffer: Buffer2D(final_color_type), context: context_type, vertex_buffer: []const vertex_type, face_count: usize, requirements: pipeline_configuration.Requirements()) void {
+            var vertices = ShadedVertices { .vertex_buffer = vertex_buffer };
+            draw(pixel_buffer, context, &vertices, face_count, requirements, true);
+        }
+
+        /// What a batched vertex stage writes for every vertex, so that `render_transformed` doesn't need to run `vertex_shader`
+        pub const TransformedVertex = struct {
+            clip_space_position: Vector4f,
+            invariants: invariant_type,
+        };
+
+        /// Same as `render`, but the vertices have already been run through a vertex shader (usually a batched one working
+        /// on several vertices at a time, see `shaders/gouraud.zig`). The faces index `transformed_vertices` just like they would index the vertex buffer.
+        pub fn render_transformed(pixel_buffer: Buffer2D(final_color_type), context: context_type, transformed_vertices: []const TransformedVertex, face_count: usize, requirements: pipeline_configuration.Requirements()) void {
+            var vertices = PretransformedVertices { .transformed_vertices = transformed_vertices };
+            draw(pixel_buffer, context, &vertices, face_count, requirements, true);
+        }
+
+        /// Same as `render`, but first tests the `bounds` of the mesh against the frustum of `model_view_projection_matrix`, before any vertex work.
+        /// Meshes completely outside of the frustum are skipped, and the ones completely inside of it skip the clipper.
+        /// Returns false if the mesh was culled.
+        pub fn render_with_bounds(pixel_buffer: Buffer2D(final_color_type), context: context_type, vertex_buffer: []const vertex_type, face_count: usize, requirements: pipeline_configuration.Requirements(), bounds: BoundingVolume, model_view_projection_matrix: M44) bool {
+            const frustum = Plane.extract_frustum_from_projection(model_view_projection_matrix);
+            var vertices = ShadedVertices { .vertex_buffer = vertex_buffer };
+            switch (bounds.classify(frustum)) {
+                .outside => return false,
+                .intersecting => draw(pixel_buffer, context, &vertices, face_count, requirements, true),
+                .inside => draw(pixel_buffer, context, &vertices, face_count, requirements, false),
+            }
+            return true;
+        }
+
+        /// What `render_instanced` takes for every instance: the type of the `instance` field of the context, if it has one
+        pub const InstanceData = if (@hasField(context_type, "instance")) std.meta.FieldType(context_type, .instance) else void;
+
+        /// Draws the mesh once per element of `instances`. The vertex shader gets the `context` with its `instance` field set to the
+        /// instance being drawn, while the fragment shader always gets the `context` as passed (anything per instance it needs has to be
+        /// passed along through the invariants). Everything else is shared by all of the instances, so with `use_multithreading` or
+        /// `use_visibility_buffer` every instance gets binned and rasterized in a single pass, as if it was a single mesh.
+        pub fn render_instanced(pixel_buffer: Buffer2D(final_color_type), context: context_type, vertex_buffer: []const vertex_type, face_count: usize, instances: []const InstanceData, requirements: pipeline_configuration.Requirements()) void {
+            if (InstanceData == void) @compileError("`render_instanced` requires the context type to have an `instance` field");
+            var vertices = InstancedVertices { .vertex_buffer = vertex_buffer, .instances = instances, .instance_context = context };
+            draw(pixel_buffer, context, &vertices, face_count, requirements, true);
+        }
+
+        /// `vertices` is where the faces get their shaded vertices from, either `*ShadedVertices`, `*PretransformedVertices` or `*InstancedVertices`
+        fn draw(pixel_buffer: Buffer2D(final_color_type), context: context_type, vertices: anytype, face_count: usize, requirements: pipeline_configuration.Requirements(), needs_clipping: bool) void {
             
+            if (pipeline_configuration.use_multithreading) {
+                tile_binning.render(pixel_buffer, context, vertices, face_count, requirements, needs_clipping);
+                return;
+            }
+
+            if (pipeline_configuration.use_visibility_buffer) {
+                var collector = TriangleCollector { .triangles = std.ArrayList(Triangle).init(requirements.allocator) };
+                defer collector.triangles.deinit();
+                process_faces(context, vertices, face_count, requirements, needs_clipping, &collector);
+                const region = Region.from_buffer(pixel_buffer);
+                for (collector.triangles.items, 0..) |*triangle, triangle_index| {
+                    rasterizer(pixel_buffer, context, requirements, region, triangle.tri, triangle.depth, triangle.w_used_for_perspective_correction, triangle.invariants, @intCast(triangle_index));
+                }
+                // only the pixels that some triangle might have covered need resolving, not the whole buffer
+                if (collector.covered_region(region)) |covered_region| resolve_visibility_buffer(pixel_buffer, context, requirements, covered_region, collector.triangles.items);
+                return;
+            }
+
+            const output = ImmediateRasterization {
+                .pixel_buffer = pixel_buffer,
+                .context = context,
+                .requirements = requirements,
+                .region = Region.from_buffer(pixel_buffer),
+            };
+            process_faces(context, vertices, face_count, requirements, needs_clipping, output);
+        }
+
+        /// Runs `process_face` for every face, and with `InstancedVertices`, for every face of every instance
+        fn process_faces(context: context_type, vertices: anytype, face_count: usize, requirements: pipeline_configuration.Requirements(), needs_clipping: bool, output: anytype) void {
+            if (@TypeOf(vertices) == *InstancedVertices) {
+                for (vertices.instances) |instance| {
+                    vertices.begin_instance(instance);
+                    var face_index: usize = 0;
+                    while (face_index < face_count) : (face_index += 1) {
+                        process_face(context, vertices, face_index, requirements, needs_clipping, output);
+                    }
+                }
+                return;
+            }
             var face_index: usize = 0;
-            label_outer: while (face_index < face_count) : (face_index += 1) {
-                
-                // 0, 1 and 2 will be the original triangle vertices.
-                // if there is clipping however
-                var invariants: [3]invariant_type = undefined;
-                var clip_space_positions: [3]Vector4f = undefined;
-                var ndcs: [3]Vector3f = undefined;
-                var screen_space_position: [3]Vector3f = undefined;
-                var w_used_for_perspective_correction: [3]f32 = undefined;
-                var depth: [3]f32 = undefined;
-                var clipped_count: usize = 0;
-
-                // pass all 3 vertices of this face through the vertex shader
-                inline for(0..3) |i| {
-                    
-                    const vertex_index = index: {
-                        if (pipeline_configuration.use_index_buffer) break :index requirements.index_buffer[face_index * 3 + i]
-                        else if (pipeline_configuration.use_index_buffer_auto) break :index
-                            // Generates the sequence 0 1 2 0 2 3 4 5 6 4 6 7 8 9 10 8 10 11 ...
-                            if (face_index%2==0) face_index * 2 + i else if (i==0) (face_index-1) * 2 else ((face_index-1) * 2) + i + 1
-                        else break :index face_index * 3 + i;
-                    };
+            while (face_index < face_count) : (face_index += 1) {
+                process_face(context, vertices, face_index, requirements, needs_clipping, output);
+            }
+        }
 
-                    const vertex_data: vertex_type = vertex_buffer[vertex_index];
+        /// Post transform cache of `use_vertex_cache`. A FIFO of the last `vertex_cache_size` indices which went through the vertex shader,
+        /// together with their clip space position and invariants. Lives for a single draw call.
+        const VertexCache = if (pipeline_configuration.use_vertex_cache) struct {
+            
+            const size = pipeline_configuration.vertex_cache_size;
+            const empty = std.math.maxInt(u32);
+            comptime {
+                if (!pipeline_configuration.use_index_buffer and !pipeline_configuration.use_index_buffer_auto) @compileError("`use_vertex_cache` requires `use_index_buffer` or `use_index_buffer_auto`");
+                std.debug.assert(size > 0);
+            }
 
-                    // As far as I understand, in your standard opengl vertex shader, the returned position is usually in
-                    // clip space, which is a homogeneous coordinate system. The `w` will be used for perspective correction.
-                    clip_space_positions[i] = vertex_shader(context, vertex_data, &invariants[i]);
-                    
-                    // NOTE This is quivalent to checking whether a point is inside the NDC cube after perspective division
-                    // 
-                    //     if (ndc.x > 1 or ndc.x < -1 or ndc.y > 1 or ndc.y < -1 or ndc.z > 1 or ndc.z < 0) {
-                    // 
-                    // if (clip_space_positions.x > clip_space_positions.w or clip_space_positions.x < -clip_space_positions.w or
-                    //     clip_space_positions.y > clip_space_positions.w or clip_space_positions.y < -clip_space_positions.w or
-                    //     clip_space_positions.z > clip_space_positions.w or clip_space_positions.z < 0) {
-                    // 
-                    // }
+            indices: [size]u32 = [_]u32 { empty } ** size,
+            clip_space_positions: [size]Vector4f = undefined,
+            invariants: [size]invariant_type = undefined,
+            /// the slot which gets replaced next
+            oldest: usize = 0,
+
+            /// returns the clip space position of the vertex at `vertex_index`, only running the vertex shader if it is not cached yet
+            fn shade(self: *@This(), context: context_type, vertex_buffer: []const vertex_type, vertex_index: usize, out_invariant: *invariant_type) Vector4f {
+                const indices: @Vector(size, u32) = self.indices;
+                if (std.simd.firstIndexOfValue(indices, @as(u32, @intCast(vertex_index)))) |slot| {
+                    out_invariant.* = self.invariants[slot];
+                    return self.clip_space_positions[slot];
+                }
+                const clip_space_position = vertex_shader(context, vertex_buffer[vertex_index], out_invariant);
+                self.indices[self.oldest] = @intCast(vertex_index);
+                self.clip_space_positions[self.oldest] = clip_space_position;
+                self.invariants[self.oldest] = out_invariant.*;
+                self.oldest = (self.oldest + 1) % size;
+                return clip_space_position;
+            }
+        } else struct {};
+
+        /// Vertices which go through `vertex_shader` (and the `VertexCache`, if enabled) as the faces ask for them
+        const ShadedVertices = struct {
+            vertex_buffer: []const vertex_type,
+            vertex_cache: VertexCache = .{},
+
+            inline fn get(self: *ShadedVertices, context: context_type, vertex_index: usize, out_invariant: *invariant_type) Vector4f {
+                if (pipeline_configuration.use_vertex_cache) return self.vertex_cache.shade(context, self.vertex_buffer, vertex_index, out_invariant);
+                return vertex_shader(context, self.vertex_buffer[vertex_index], out_invariant);
+            }
+        };
+
+        /// Same as `ShadedVertices`, but the vertex shader gets its own copy of the context, with the `instance` being drawn in it
+        const InstancedVertices = struct {
+            vertex_buffer: []const vertex_type,
+            instances: []const InstanceData,
+            instance_context: context_type,
+            vertex_cache: VertexCache = .{},
+
+            fn begin_instance(self: *InstancedVertices, instance: InstanceData) void {
+                self.instance_context.instance = instance;
+                // the same indices are different vertices in another instance
+                self.vertex_cache = .{};
+            }
 
+            inline fn get(self: *InstancedVertices, context: context_type, vertex_index: usize, out_invariant: *invariant_type) Vector4f {
+                _ = context;
+                if (pipeline_configuration.use_vertex_cache) return self.vertex_cache.shade(self.instance_context, self.vertex_buffer, vertex_index, out_invariant);
+                return vertex_shader(self.instance_context, self.vertex_buffer[vertex_index], out_invariant);
+            }
+        };
+
+        /// Vertices which were already shaded before the draw call, by a batched vertex stage
+        const PretransformedVertices = struct {
+            transformed_vertices: []const TransformedVertex,
+
+            inline fn get(self: *PretransformedVertices, context: context_type, vertex_index: usize, out_invariant: *invariant_type) Vector4f {
+                _ = context;
+                const transformed_vertex = &self.transformed_vertices[vertex_index];
+                out_invariant.* = transformed_vertex.invariants;
+                return transformed_vertex.clip_space_position;
+            }
+        };
+
+        /// Gets the 3 shaded vertices of the face `face_index` from `vertices`, clips the result if necessary and hands
+        /// every resulting screen space triangle to `output`, which must have a method `emit(tri, depth, w_used_for_perspective_correction, invariants)`.
+        /// `needs_clipping` is false when the whole mesh is known to be inside of the frustum.
+        fn process_face(context: context_type, vertices: anytype, face_index: usize, requirements: pipeline_configuration.Requirements(), needs_clipping: bool, output: anytype) void {
+
+            var invariants: [3]invariant_type = undefined;
+            var clip_space_positions: [3]Vector4f = undefined;
+            var screen_space_position: [3]Vector3f = undefined;
+            var w_used_for_perspective_correction: [3]f32 = undefined;
+            var depth: [3]f32 = undefined;
+
+            // pass all 3 vertices of this face through the vertex shader
+            inline for(0..3) |i| {
+                
+                const vertex_index = index: {
+                    if (pipeline_configuration.use_index_buffer) break :index requirements.index_buffer[face_index * 3 + i]
+                    else if (pipeline_configuration.use_index_buffer_auto) break :index
+                        // Generates the sequence 0 1 2 0 2 3 4 5 6 4 6 7 8 9 10 8 10 11 ...
+                        if (face_index%2==0) face_index * 2 + i else if (i==0) (face_index-1) * 2 else ((face_index-1) * 2) + i + 1
+                    else break :index face_index * 3 + i;
+                };
+
+                // As far as I understand, in your standard opengl vertex shader, the returned position is usually in
+                // clip space, which is a homogeneous coordinate system. The `w` will be used for perspective correction.
+                clip_space_positions[i] = vertices.get(context, vertex_index, &invariants[i]);
+                
+                // NOTE This is quivalent to checking whether a point is inside the NDC cube after perspective division
+                // 
+                //     if (ndc.x > 1 or ndc.x < -1 or ndc.y > 1 or ndc.y < -1 or ndc.z > 1 or ndc.z < 0) {
+                // 
+                // if (clip_space_positions.x > clip_space_positions.w or clip_space_positions.x < -clip_space_positions.w or
+                //     clip_space_positions.y > clip_space_positions.w or clip_space_positions.y < -clip_space_positions.w or
+                //     clip_space_positions.z > clip_space_positions.w or clip_space_positions.z < 0) {
+                // 
+                // }
+
+                // without clipping, any triangle with a vertex outside of the NDC cube is just skipped
+                if (!pipeline_configuration.do_triangle_clipping or !needs_clipping) {
                     const ndc = clip_space_positions[i].perspective_division();
-                    ndcs[i] = ndc;
-                    if (ndc.x > 1 or ndc.x < -1 or ndc.y > 1 or ndc.y < -1 or ndc.z > 1 or ndc.z < 0) {
-                        if (pipeline_configuration.do_triangle_clipping) {
-                            clipped_count += 1;
-                            if (clipped_count == 3) continue :label_outer;
-                        }
-                        else continue :label_outer;
+                    if (!pipeline_configuration.do_triangle_clipping) {
+                        if (ndc.x > 1 or ndc.x < -1 or ndc.y > 1 or ndc.y < -1 or ndc.z > 1 or ndc.z < 0) return;
                     }
                     if (pipeline_configuration.do_depth_testing) depth[i] = ndc.z;
                     if (pipeline_configuration.do_perspective_correct_interpolation) w_used_for_perspective_correction[i] = clip_space_positions[i].w;
                     screen_space_position[i] = requirements.viewport_matrix.apply_to_vec3(ndc).perspective_division();
                 }
+            }
 
-                if (pipeline_configuration.do_triangle_clipping) {
-                    if (clipped_count == 0) {
-                        rasterizer(pixel_buffer, context, requirements, screen_space_position[0..3].*, depth[0..3].*, w_used_for_perspective_correction[0..3].*, invariants[0..3].*);
-                        
-                        // line(win32.RGBA, pixel_buffer, Vector2i { .x = @intFromFloat(tri[0].x), .y = @intFromFloat(tri[0].y) }, Vector2i { .x = @intFromFloat(tri[1].x), .y = @intFromFloat(tri[1].y) }, .{.r = 255, .g = 0, .b = 0, .a = 255 });
-                        // line(win32.RGBA, pixel_buffer, Vector2i { .x = @intFromFloat(tri[1].x), .y = @intFromFloat(tri[1].y) }, Vector2i { .x = @intFromFloat(tri[2].x), .y = @intFromFloat(tri[2].y) }, .{.r = 255, .g = 0, .b = 0, .a = 255 });
-                        // line(win32.RGBA, pixel_buffer, Vector2i { .x = @intFromFloat(tri[2].x), .y = @intFromFloat(tri[2].y) }, Vector2i { .x = @intFromFloat(tri[0].x), .y = @intFromFloat(tri[0].y) }, .{.r = 255, .g = 0, .b = 0, .a = 255 });
+            if (pipeline_configuration.do_triangle_clipping and needs_clipping) clipping.clip_and_emit(requirements, clip_space_positions, invariants, output)
+            else output.emit(screen_space_position, depth, w_used_for_perspective_correction, with_level_of_detail(screen_space_position, invariants));
+        }
+
+        /// Used by `texture_level_of_detail`. The derivatives are per triangle rather than per 2x2 pixel quad, since fragments are shaded one at a time
+        inline fn with_level_of_detail(screen_space_positions: [3]Vector3f, invariants: [3]invariant_type) [3]invariant_type {
+            if (pipeline_configuration.texture_level_of_detail) |lod| {
+                const uv_a: Vector2f = @field(invariants[0], lod.uv_field);
+                const uv_b: Vector2f = @field(invariants[1], lod.uv_field);
+                const uv_c: Vector2f = @field(invariants[2], lod.uv_field);
+                const a = screen_space_positions[0];
+                const b = screen_space_positions[1];
+                const c = screen_space_positions[2];
+                const uv_area = @abs((uv_b.x - uv_a.x) * (uv_c.y - uv_a.y) - (uv_b.y - uv_a.y) * (uv_c.x - uv_a.x));
+                const screen_area = @abs((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x));
+                const uv_per_pixel: f32 = if (screen_area > 0) @sqrt(uv_area / screen_area) else 0;
+                var result = invariants;
+                inline for (&result) |*invariant| @field(invariant.*, lod.uv_per_pixel_field) = uv_per_pixel;
+                return result;
+            }
+            else return invariants;
+        }
+
+        /// Used by `do_triangle_clipping`. Clips in homogeneous clip space, before the perspective division, so nothing ever gets divided by
+        /// a `w` which is 0 or negative, and works on fixed size arrays on the stack. Only the near and far planes are always clipped against.
+        /// Triangles crossing the sides of the view volume are accepted as they are as long as they fit in the guard band, since the
+        /// rasterizers already skip the pixels outside of the screen.
+        const clipping = struct {
+
+            /// rasterize_2 can't deal with vertices outside of the screen, so it gets no guard band
+            const guard_band: f32 = if (pipeline_configuration.use_triangle_2 and !pipeline_configuration.use_triangle_simd and !pipeline_configuration.use_triangle_fixed_point) 1 else pipeline_configuration.clipping_guard_band;
+            comptime { std.debug.assert(guard_band >= 1); }
+
+            /// clipping a convex polygon against a plane adds one vertex at most, and there are 6 planes
+            const max_vertices = 3 + 6;
+
+            const ClipPlane = enum { near, far, left, right, bottom, top };
+
+            const ClipVertex = struct {
+                position: Vector4f,
+                /// `P = weights.x * A + weights.y * B + weights.z * C`, where A, B and C are the vertices of the original triangle
+                weights: Vector3f,
+            };
+
+            /// positive when `p` is on the inner side of `plane`. The sides are pushed out by `band`, where 1 is the border of the view volume
+            inline fn distance(comptime plane: ClipPlane, p: Vector4f, band: f32) f32 {
+                return switch (plane) {
+                    .near => p.z,
+                    .far => p.w - p.z,
+                    .left => p.x + band * p.w,
+                    .right => band * p.w - p.x,
+                    .bottom => p.y + band * p.w,
+                    .top => band * p.w - p.y,
+                };
+            }
+
+            inline fn lerp(from: ClipVertex, to: ClipVertex, t: f32) ClipVertex {
+                return .{
+                    .position = from.position.add(to.position.add(from.position.scale(-1)).scale(t)),
+                    .weights = from.weights.add(to.weights.substract(from.weights).scale(t)),
+                };
+            }
+
+            /// Sutherland-Hodgman against a single plane. Returns the new vertex count, or null if every vertex was already inside
+            fn clip_polygon(comptime plane: ClipPlane, band: f32, polygon: *[max_vertices]ClipVertex, count: usize) ?usize {
+                var distances: [max_vertices]f32 = undefined;
+                var any_outside = false;
+                for (polygon[0..count], 0..) |vertex, i| {
+                    distances[i] = distance(plane, vertex.position, band);
+                    if (distances[i] < 0) any_outside = true;
+                }
+                if (!any_outside) return null;
+
+                const input = polygon.*;
+                var new_count: usize = 0;
+                var previous = count - 1;
+                for (0..count) |current| {
+                    const previous_inside = distances[previous] >= 0;
+                    const current_inside = distances[current] >= 0;
+                    if (previous_inside != current_inside) {
+                        // always go from the inside vertex to the outside one, so that an edge shared by 2 triangles is cut at the exact same point
+                        polygon[new_count] =
+                            if (previous_inside) lerp(input[previous], input[current], distances[previous] / (distances[previous] - distances[current]))
+                            else lerp(input[current], input[previous], distances[current] / (distances[current] - distances[previous]));
+                        new_count += 1;
                     }
-                    else {
-                        
-                        trace("clipping", .{});
-                        trace("clip space", .{});
-                        trace_triangle_4(clip_space_positions[0..3].*);
-                        trace("ndc", .{});
-                        trace_triangle(ndcs[0..3].*);
-                        trace_mat4(context.projection_matrix);
-
-                        const left_bottom_near = comptime Vector3f.from(-1,-1,0);
-                        const right_top_far = comptime Vector3f.from(1,1,1);
-                        const frustum = comptime Frustum {
-                            .left = Plane.from(left_bottom_near, Vector3f.from(1,0,0)),
-                            .right = Plane.from(right_top_far, Vector3f.from(-1,0,0)),
-                            .bottom = Plane.from(left_bottom_near, Vector3f.from(0,1,0)),
-                            .top = Plane.from(right_top_far, Vector3f.from(0,-1,0)),
-                            .near = Plane.from(left_bottom_near, Vector3f.from(0,0,1)),
-                            .far = Plane.from(right_top_far, Vector3f.from(0,0,-1) ),
-                        };
+                    if (current_inside) {
+                        polygon[new_count] = input[current];
+                        new_count += 1;
+                    }
+                    previous = current;
+                }
+                return new_count;
+            }
 
-                        const VertexList = struct {
-                            const VertexLinkedList = std.DoublyLinkedList(Vector3f);
-                            data: std.ArrayList(VertexLinkedList.Node),
-                            list: VertexLinkedList,
-                            fn init(allocator: std.mem.Allocator) @This() {
-                                return .{
-                                    .data = std.ArrayList(VertexLinkedList.Node).initCapacity(allocator, 15) catch unreachable,
-                                    .list = VertexLinkedList {}
-                                };
-                            }
-                            fn add(self: *@This(), vertex: Vector3f) void {
-                                const ptr = self.data.addOneAssumeCapacity();
-                                ptr.* = .{ .data = vertex };
-                                self.list.append(ptr);
-                            }
-                            fn clear(self: *@This()) void {
-                                self.list = VertexLinkedList {};
-                                self.data.clearRetainingCapacity();
-                            }
-                            fn free(self: *@This()) void {
-                                self.data.clearAndFree();
-                            }
-                            fn first(self: @This()) ?*VertexLinkedList.Node {
-                                return self.list.first;
-                            }
-                            fn last(self: @This()) ?*VertexLinkedList.Node {
-                                return self.list.last;
-                            }
-                            fn pop_first(self: *@This()) Vector3f {
-                                return self.list.popFirst().?.data;
-                            }
-                            fn next(self: *@This()) ?Vector3f {
-                                return if (self.list.popFirst()) |n| n.data else null;
-                            }
-                            fn move_to_other(self: *@This(), other: *@This()) void {
-                                while (self.list.popFirst()) |item| {
-                                    other.add(item.data);
-                                }
-                                self.clear();
-                            }
-                        };
+            fn clip_and_emit(requirements: pipeline_configuration.Requirements(), clip_space_positions: [3]Vector4f, invariants: [3]invariant_type, output: anytype) void {
+                
+                // skip the triangles which are completely outside of any of the planes of the view volume
+                inline for (comptime std.enums.values(ClipPlane)) |plane| {
+                    if (distance(plane, clip_space_positions[0], 1) < 0 and distance(plane, clip_space_positions[1], 1) < 0 and distance(plane, clip_space_positions[2], 1) < 0) return;
+                }
 
-                        var buffer: [1024*4]u8 = undefined;
-                        var fba = std.heap.FixedBufferAllocator.init(&buffer);
-                        var vertex_list = VertexList.init(fba.allocator());
-                        vertex_list.add(ndcs[0]);
-                        vertex_list.add(ndcs[1]);
-                        vertex_list.add(ndcs[2]);
-                        var temp_vertex_list = VertexList.init(fba.allocator());
-
-                        // for each plane `p`
-                        inline for (@typeInfo(Frustum).Struct.fields) |field| {
-                            const p: Plane = @field(frustum, field.name);
-
-                            // for each pair of vertices v1, v2
-                            var v1 = vertex_list.last().?;
-                            var v2 = vertex_list.first().?;
-                            
-                            // this is basically a `do {} while {}`
-                            while (true) {
-                                const v1_inside: bool = (p.classify_point(v1.data) != .negative);
-                                const v2_inside: bool = (p.classify_point(v2.data) != .negative);
-                                if (v2_inside != v1_inside) {
-                                    temp_vertex_list.add(p.intersection(v1.data, v2.data));
-                                }
-                                if (v2_inside) {
-                                    temp_vertex_list.add(v2.data);
-                                }
-
-                                if (v2 == vertex_list.last().?) break // break condition
-                                else { // continue
-                                    v1 = v2;
-                                    v2 = v2.next.?;
-                                }
-                            }
+                var polygon: [max_vertices]ClipVertex = undefined;
+                polygon[0] = .{ .position = clip_space_positions[0], .weights = Vector3f.from(1, 0, 0) };
+                polygon[1] = .{ .position = clip_space_positions[1], .weights = Vector3f.from(0, 1, 0) };
+                polygon[2] = .{ .position = clip_space_positions[2], .weights = Vector3f.from(0, 0, 1) };
+                var count: usize = 3;
+                var clipped = false;
+                inline for (comptime std.enums.values(ClipPlane)) |plane| {
+                    const band: f32 = if (plane == .near or plane == .far) 1 else guard_band;
+                    if (clip_polygon(plane, band, &polygon, count)) |new_count| {
+                        count = new_count;
+                        clipped = true;
+                        if (count < 3) return;
+                    }
+                }
+                if (clipped) trace("clipped to {} vertices ({} triangles)", .{count, count-2});
+
+                var screen_space_positions: [max_vertices]Vector3f = undefined;
+                var depth: [max_vertices]f32 = undefined;
+                var w_used_for_perspective_correction: [max_vertices]f32 = undefined;
+                var clipped_invariants: [max_vertices]invariant_type = undefined;
+                for (polygon[0..count], 0..) |vertex, i| {
+                    const ndc = vertex.position.perspective_division();
+                    screen_space_positions[i] = requirements.viewport_matrix.apply_to_vec3(ndc).perspective_division();
+                    depth[i] = ndc.z;
+                    w_used_for_perspective_correction[i] = vertex.position.w;
+                    // the invariants are linear in clip space, so the weights need no perspective correction
+                    clipped_invariants[i] = if (clipped) interpolate(invariant_type, invariants, vertex.weights.y, vertex.weights.z, vertex.weights.x) else invariants[i];
+                }
 
-                            vertex_list.clear();
-                            temp_vertex_list.move_to_other(&vertex_list);
-                        }
+                // emit the polygon as a triangle fan
+                for (1..count - 1) |i| {
+                    output.emit(
+                        .{ screen_space_positions[0], screen_space_positions[i], screen_space_positions[i + 1] },
+                        .{ depth[0], depth[i], depth[i + 1] },
+                        .{ w_used_for_perspective_correction[0], w_used_for_perspective_correction[i], w_used_for_perspective_correction[i + 1] },
+                        with_level_of_detail(
+                            .{ screen_space_positions[0], screen_space_positions[i], screen_space_positions[i + 1] },
+                            .{ clipped_invariants[0], clipped_invariants[i], clipped_invariants[i + 1] },
+                        ),
+                    );
+                }
+            }
+        };
 
-                        if (pipeline_configuration.trace) {
-                            var count: usize = 0;
-                            var n = vertex_list.first();
-                            while (n) |node| {
-                                count += 1 ;
-                                n = node.next;
-                            }
-                            trace("clipped to {} vertices ({} triangles)", .{count, count-2});
-                        }
+        /// A region of the pixel buffer, in pixels. `right` and `top` are exclusive.
+        const Region = struct {
+            left: usize,
+            bottom: usize,
+            right: usize,
+            top: usize,
 
-                        const to_interpolate = struct {
-                            depth: f32,
-                            w_used_for_perspective_correction: f32,
-                        };
-                        const orig_triangle_data = [3]to_interpolate {
-                            .{
-                                .depth = depth[0],
-                                .w_used_for_perspective_correction = w_used_for_perspective_correction[0],
-                            },
-                            .{
-                                .depth = depth[1],
-                                .w_used_for_perspective_correction = w_used_for_perspective_correction[1],
-                            },
-                            .{
-                                .depth = depth[2],
-                                .w_used_for_perspective_correction = w_used_for_perspective_correction[2],
-                            },
-                        };
+            fn from_buffer(pixel_buffer: Buffer2D(final_color_type)) Region {
+                return .{ .left = 0, .bottom = 0, .right = pixel_buffer.width, .top = pixel_buffer.height };
+            }
+        };
 
-                        const vertex_1: Vector3f = vertex_list.pop_first();
-                        const screen_space_1 = requirements.viewport_matrix.apply_to_vec3(vertex_1).perspective_division();
-                        
-                        var vertex_2: Vector3f = vertex_list.pop_first();
-                        var vertex_3: Vector3f = vertex_list.pop_first();
+        /// The default output of `process_face`, which rasterizes every triangle as soon as it is emitted
+        const ImmediateRasterization = struct {
+            pixel_buffer: Buffer2D(final_color_type),
+            context: context_type,
+            requirements: pipeline_configuration.Requirements(),
+            region: Region,
 
-                        while (true) { // This is basically a `do {} while {}`
-                            
-                            trace_triangle([3]Vector3f{vertex_1, vertex_2, vertex_3});
-                            
-                            const screen_space_2 = requirements.viewport_matrix.apply_to_vec3(vertex_2).perspective_division();
-                            const screen_space_3 = requirements.viewport_matrix.apply_to_vec3(vertex_3).perspective_division();
-
-                            var a = screen_space_1;
-                            a.z = 0;
-                            var b = screen_space_2;
-                            b.z = 0;
-                            var c = screen_space_3;
-                            c.z = 0;
-                            const bar_a = barycentric(screen_space_position[0..3].*, a);
-                            const bar_b = barycentric(screen_space_position[0..3].*, b);
-                            const bar_c = barycentric(screen_space_position[0..3].*, c);
-
-                            const interpolated_a: to_interpolate = 
-                                if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(to_interpolate, orig_triangle_data, w_used_for_perspective_correction[0..3].*, bar_a.x, bar_a.y, bar_a.z)
-                                else interpolate(to_interpolate, orig_triangle_data, bar_a.x, bar_a.y, bar_a.z);
-                            const interpolated_b: to_interpolate = 
-                                if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(to_interpolate, orig_triangle_data, w_used_for_perspective_correction[0..3].*, bar_b.x, bar_b.y, bar_b.z)
-                                else interpolate(to_interpolate, orig_triangle_data, bar_b.x, bar_b.y, bar_b.z);
-                            const interpolated_c: to_interpolate = 
-                                if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(to_interpolate, orig_triangle_data, w_used_for_perspective_correction[0..3].*, bar_c.x, bar_c.y, bar_c.z)
-                                else interpolate(to_interpolate, orig_triangle_data, bar_c.x, bar_c.y, bar_c.z);
-                            
-                            const invariants_a = if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(invariant_type, invariants[0..3].*, w_used_for_perspective_correction[0..3].*, bar_a.x, bar_a.y, bar_a.z)
-                                else interpolate(invariant_type, invariants[0..3].*, bar_a.x, bar_a.y, bar_a.z);
-                            const invariants_b = if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(invariant_type, invariants[0..3].*, w_used_for_perspective_correction[0..3].*, bar_b.x, bar_b.y, bar_b.z)
-                                else interpolate(invariant_type, invariants[0..3].*, bar_b.x, bar_b.y, bar_b.z);
-                            const invariants_c = if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(invariant_type, invariants[0..3].*, w_used_for_perspective_correction[0..3].*, bar_c.x, bar_c.y, bar_c.z)
-                                else interpolate(invariant_type, invariants[0..3].*, bar_c.x, bar_c.y, bar_c.z);
-
-                            // TODO I got two bugs!
-                            // 1. Sometimes I get negative uvs not sure why, it only happens when I do perspective correction tho! (Actually I might be wrong about that and I might be getting it without the correction as well)
-                            // 2. sometimes the NDC coordinates suddenly go from, say, 23, to -134. Usually when I am close to the clipped triangle and rotate the camera until I'm getting more paralel
-                            // meaning that the resulting clipped triangle looks completely out of place. I'm not sure how to go about that
-
-                            rasterizer(pixel_buffer, context, requirements, .{ screen_space_1, screen_space_2, screen_space_3 }, .{ interpolated_a.depth, interpolated_b.depth, interpolated_c.depth }, .{ interpolated_a.w_used_for_perspective_correction, interpolated_b.w_used_for_perspective_correction, interpolated_c.w_used_for_perspective_correction }, .{ invariants_a, invariants_b, invariants_c });
-
-                            // line(win32.RGBA, pixel_buffer, Vector2i { .x = @intFromFloat(screen_space_1.x), .y = @intFromFloat(screen_space_1.y) }, Vector2i { .x = @intFromFloat(screen_space_2.x), .y = @intFromFloat(screen_space_2.y) }, .{.r = 0, .g = 255, .b = 0, .a = 255 });
-                            // line(win32.RGBA, pixel_buffer, Vector2i { .x = @intFromFloat(screen_space_2.x), .y = @intFromFloat(screen_space_2.y) }, Vector2i { .x = @intFromFloat(screen_space_3.x), .y = @intFromFloat(screen_space_3.y) }, .{.r = 0, .g = 255, .b = 0, .a = 255 });
-                            // line(win32.RGBA, pixel_buffer, Vector2i { .x = @intFromFloat(screen_space_3.x), .y = @intFromFloat(screen_space_3.y) }, Vector2i { .x = @intFromFloat(screen_space_1.x), .y = @intFromFloat(screen_space_1.y) }, .{.r = 0, .g = 255, .b = 0, .a = 255 });
-
-                            // raster the next triangle? or break if we have already drawn them all
-                            if (vertex_list.next()) |next_vertex| {
-                                vertex_2 = vertex_3;
-                                vertex_3 = next_vertex;
-                            }
-                            else break;
+            fn emit(self: ImmediateRasterization, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type) void {
+                rasterizer(self.pixel_buffer, self.context, self.requirements, self.region, tri, depth, w_used_for_perspective_correction, invariants, 0);
+            }
+        };
+
+        /// A screen space triangle as emitted by `process_face`, kept around by the outputs which rasterize after the front end is done
+        const Triangle = struct {
+            tri: [3]Vector3f,
+            depth: [3]f32,
+            w_used_for_perspective_correction: [3]f32,
+            invariants: [3]invariant_type,
+            /// set up once when the triangle is collected, so that `resolve_visibility_buffer` only has to evaluate them per pixel
+            attributes: if (pipeline_configuration.use_visibility_buffer) AttributePlanes else void,
+        };
+
+        /// The output of `process_face` which just stores the triangles, in order, in `triangles`
+        const TriangleCollector = struct {
+            triangles: std.ArrayList(Triangle),
+            /// union of the bounding boxes of `triangles`, in screen space
+            min: Vector2f = .{ .x = std.math.inf(f32), .y = std.math.inf(f32) },
+            max: Vector2f = .{ .x = -std.math.inf(f32), .y = -std.math.inf(f32) },
+
+            fn emit(self: *TriangleCollector, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type) void {
+                for (tri) |vertex| {
+                    self.min = .{ .x = @min(self.min.x, vertex.x), .y = @min(self.min.y, vertex.y) };
+                    self.max = .{ .x = @max(self.max.x, vertex.x), .y = @max(self.max.y, vertex.y) };
+                }
+                self.triangles.append(.{
+                    .tri = tri,
+                    .depth = depth,
+                    .w_used_for_perspective_correction = w_used_for_perspective_correction,
+                    .invariants = invariants,
+                    .attributes = if (pipeline_configuration.use_visibility_buffer) AttributePlanes.from(invariants, w_used_for_perspective_correction) else {},
+                }) catch @panic("OOM");
+            }
+
+            /// the part of `region` which the collected triangles might cover, or null if they don't overlap it
+            fn covered_region(self: *const TriangleCollector, region: Region) ?Region {
+                if (self.triangles.items.len == 0) return null;
+                return rasterizers.conservative_box_bounds(region, self.min, self.max);
+            }
+        };
+
+        /// Second pass of `use_visibility_buffer`. Runs the fragment shader once for every pixel of `region` that some triangle covered,
+        /// and clears the visibility buffer back to empty on the way.
+        fn resolve_visibility_buffer(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, triangles: []const Triangle) void {
+            for (region.bottom..region.top) |y| {
+                for (region.left..region.right) |x| {
+                    const entry = requirements.visibility_buffer.at(x, y);
+                    if (entry.triangle_id == VisibilityBufferEntry.empty.triangle_id) continue;
+                    const triangle = &triangles[entry.triangle_id];
+                    pixel_buffer.set(x, y, fragment_shader(context, triangle.attributes.at(entry.u, entry.v)));
+                    entry.* = VisibilityBufferEntry.empty;
+                }
+            }
+        }
+
+        /// `z` in the format of the depth buffer
+        inline fn encode_depth(z: f32) pipeline_configuration.depth_format.Type() {
+            return pipeline_configuration.depth_format.encode(z);
+        }
+
+        /// true where the (encoded) depth `z` is at least as close as the `stored` one. Works on both single values and vectors
+        inline fn depth_passes(stored: anytype, z: @TypeOf(stored)) @TypeOf(stored >= z) {
+            return depth_test_passes(pipeline_configuration.reversed_z, stored, z);
+        }
+
+        /// Tests the depth `z` of the pixel at `x`, `y` against the depth buffer, and if it passes, writes it
+        inline fn depth_test(requirements: pipeline_configuration.Requirements(), x: usize, y: usize, z: f32) bool {
+            const encoded = encode_depth(z);
+            if (!depth_passes(requirements.depth_buffer.get(x, y), encoded)) return false;
+            requirements.depth_buffer.set(x, y, encoded);
+            return true;
+        }
+
+        /// What every rasterizer does with a pixel that is covered by the triangle and passed the depth test.
+        /// Either shade it right away or, when `use_visibility_buffer`, just remember which triangle covers it for `resolve_visibility_buffer`
+        inline fn shade_fragment(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), x: usize, y: usize, triangle_id: u32, attributes: AttributePlanes, u: f32, v: f32) void {
+            if (pipeline_configuration.use_visibility_buffer) {
+                requirements.visibility_buffer.set(x, y, .{ .triangle_id = triangle_id, .u = u, .v = v });
+                return;
+            }
+
+            const final_color = fragment_shader(context, attributes.at(u, v));
+            
+            const blend_mode = comptime pipeline_configuration.effective_blend_mode();
+            if (blend_mode != .@"opaque") {
+                const old_color = pixel_buffer.get(x, y);
+                pixel_buffer.set(x, y, pixels.blend_pixel(final_color_type, blend_mode, final_color, old_color));
+            }
+            else pixel_buffer.set(x, y, final_color);
+        }
+
+        /// Used when `use_multithreading` is set. The front end (vertex shader, clipping and viewport transform) runs on the calling
+        /// thread and collects every screen space triangle. Those get binned into square tiles of `multithreading_tile_size` pixels,
+        /// and each tile is rasterized (and with `use_visibility_buffer`, resolved) as a single job on `requirements.thread_pool`. A tile is only ever touched by the job which
+        /// owns it, so the pixel and depth buffers need no locking, and since triangles are binned in submission order the result
+        /// is the same as the one of the serial path.
+        const tile_binning = struct {
+
+            const tile_size = pipeline_configuration.multithreading_tile_size;
+            comptime { std.debug.assert(tile_size > 0); }
+
+            /// Everything a tile job needs. Lives on the stack of `render` until every job is done.
+            const Frame = struct {
+                pixel_buffer: Buffer2D(final_color_type),
+                context: context_type,
+                requirements: pipeline_configuration.Requirements(),
+                triangles: []const Triangle,
+                tiles_x: usize,
+                /// the indices in `bins` of the triangles overlapping tile `i` are `bin_offsets[i]..bin_offsets[i+1]`
+                bin_offsets: []const usize,
+                bins: []const u32,
+            };
+
+            /// The range of tiles, `right` and `top` exclusive
+            const TileRange = struct {
+                left: usize,
+                bottom: usize,
+                right: usize,
+                top: usize,
+            };
+
+            fn render(pixel_buffer: Buffer2D(final_color_type), context: context_type, vertices: anytype, face_count: usize, requirements: pipeline_configuration.Requirements(), needs_clipping: bool) void {
+                const allocator = requirements.allocator;
+
+                var collector = TriangleCollector { .triangles = std.ArrayList(Triangle).init(allocator) };
+                defer collector.triangles.deinit();
+                process_faces(context, vertices, face_count, requirements, needs_clipping, &collector);
+                const triangles = collector.triangles.items;
+                if (triangles.len == 0) return;
+
+                const tiles_x = std.math.divCeil(usize, pixel_buffer.width, tile_size) catch unreachable;
+                const tiles_y = std.math.divCeil(usize, pixel_buffer.height, tile_size) catch unreachable;
+                const tile_count = tiles_x * tiles_y;
+
+                // count how many triangles overlap each tile, then turn the counts into offsets
+                const bin_offsets = allocator.alloc(usize, tile_count + 1) catch @panic("OOM");
+                defer allocator.free(bin_offsets);
+                @memset(bin_offsets, 0);
+                for (triangles) |*triangle| {
+                    const range = tile_range(triangle.tri, pixel_buffer, tiles_x, tiles_y) orelse continue;
+                    for (range.bottom..range.top) |tile_y| {
+                        for (range.left..range.right) |tile_x| bin_offsets[tile_y * tiles_x + tile_x + 1] += 1;
+                    }
+                }
+                for (1..tile_count + 1) |i| bin_offsets[i] += bin_offsets[i - 1];
+
+                // fill the bins in submission order, so that every tile sees its triangles in the same order as the serial path
+                const bins = allocator.alloc(u32, bin_offsets[tile_count]) catch @panic("OOM");
+                defer allocator.free(bins);
+                const cursors = allocator.alloc(usize, tile_count) catch @panic("OOM");
+                defer allocator.free(cursors);
+                @memcpy(cursors, bin_offsets[0..tile_count]);
+                for (triangles, 0..) |*triangle, triangle_index| {
+                    const range = tile_range(triangle.tri, pixel_buffer, tiles_x, tiles_y) orelse continue;
+                    for (range.bottom..range.top) |tile_y| {
+                        for (range.left..range.right) |tile_x| {
+                            const tile_index = tile_y * tiles_x + tile_x;
+                            bins[cursors[tile_index]] = @intCast(triangle_index);
+                            cursors[tile_index] += 1;
                         }
                     }
                 }
-                else rasterizer(pixel_buffer, context, requirements, screen_space_position[0..3].*, depth[0..3].*, w_used_for_perspective_correction[0..3].*, invariants[0..3].*);
+
+                const frame = Frame {
+                    .pixel_buffer = pixel_buffer,
+                    .context = context,
+                    .requirements = requirements,
+                    .triangles = triangles,
+                    .tiles_x = tiles_x,
+                    .bin_offsets = bin_offsets,
+                    .bins = bins,
+                };
+                var wait_group = std.Thread.WaitGroup {};
+                for (0..tile_count) |tile_index| {
+                    if (bin_offsets[tile_index] == bin_offsets[tile_index + 1]) continue;
+                    wait_group.start();
+                    // if the job cant be queued just rasterize the tile right here
+                    requirements.thread_pool.spawn(rasterize_tile, .{ &frame, tile_index, &wait_group }) catch rasterize_tile(&frame, tile_index, &wait_group);
+                }
+                // the calling thread helps out until every tile is done
+                requirements.thread_pool.waitAndWork(&wait_group);
             }
-        }
+
+            /// returns the tiles overlapped by the bounding box of `tri`, or null if it is outside of the pixel buffer.
+            /// The bounding box is grown by a pixel on every side so that the rounding of any rasterizer stays inside of it.
+            fn tile_range(tri: [3]Vector3f, pixel_buffer: Buffer2D(final_color_type), tiles_x: usize, tiles_y: usize) ?TileRange {
+                const min_x = @min(tri[0].x, @min(tri[1].x, tri[2].x)) - 1;
+                const min_y = @min(tri[0].y, @min(tri[1].y, tri[2].y)) - 1;
+                const max_x = @max(tri[0].x, @max(tri[1].x, tri[2].x)) + 1;
+                const max_y = @max(tri[0].y, @max(tri[1].y, tri[2].y)) + 1;
+                const width: f32 = @floatFromInt(pixel_buffer.width);
+                const height: f32 = @floatFromInt(pixel_buffer.height);
+                if (max_x < 0 or max_y < 0 or min_x >= width or min_y >= height) return null;
+                const left: usize = @intFromFloat(@max(min_x, 0));
+                const bottom: usize = @intFromFloat(@max(min_y, 0));
+                const right: usize = @intFromFloat(@min(max_x, width - 1));
+                const top: usize = @intFromFloat(@min(max_y, height - 1));
+                return TileRange {
+                    .left = left / tile_size,
+                    .bottom = bottom / tile_size,
+                    .right = @min(right / tile_size + 1, tiles_x),
+                    .top = @min(top / tile_size + 1, tiles_y),
+                };
+            }
+
+            fn rasterize_tile(frame: *const Frame, tile_index: usize, wait_group: *std.Thread.WaitGroup) void {
+                defer wait_group.finish();
+                const tile_x = tile_index % frame.tiles_x;
+                const tile_y = tile_index / frame.tiles_x;
+                const region = Region {
+                    .left = tile_x * tile_size,
+                    .bottom = tile_y * tile_size,
+                    .right = @min((tile_x + 1) * tile_size, frame.pixel_buffer.width),
+                    .top = @min((tile_y + 1) * tile_size, frame.pixel_buffer.height),
+                };
+                for (frame.bins[frame.bin_offsets[tile_index]..frame.bin_offsets[tile_index + 1]]) |triangle_index| {
+                    const triangle = &frame.triangles[triangle_index];
+                    rasterizer(frame.pixel_buffer, frame.context, frame.requirements, region, triangle.tri, triangle.depth, triangle.w_used_for_perspective_correction, triangle.invariants, triangle_index);
+                }
+                if (pipeline_configuration.use_visibility_buffer) resolve_visibility_buffer(frame.pixel_buffer, frame.context, frame.requirements, region, frame.triangles);
+            }
+        };
     
         // NOTE currently rasterize_2 has some issues with filling conventions, gotta fix those. It performs much better however.
-        // eventually if multithreading is added, I expect rasterize_1 to be much more multithreading friendly tho...
-        const rasterizer = if (pipeline_configuration.use_triangle_2) rasterizers.rasterize_2 else  rasterizers.rasterize_1;
+        // rasterize_fixed_point is the one to use when shared edges matter (blending, dense meshes), since it follows the top-left rule.
+        // Both rasterizers only ever touch the pixels inside of `region`, which is what allows `use_multithreading` to split the work in tiles,
+        // and `do_hierarchical_depth_testing` to split it in runs of visible blocks.
+        const rasterizer = if (pipeline_configuration.use_lazy_clear) rasterizers.rasterize_lazily_cleared else culling_rasterizer;
+        const culling_rasterizer = if (pipeline_configuration.do_hierarchical_depth_testing) rasterizers.rasterize_hierarchical_depth_culled else triangle_rasterizer;
+        const triangle_rasterizer = blk: {
+            if (pipeline_configuration.use_triangle_simd and pipeline_configuration.use_triangle_fixed_point) @compileError("Only one option can be active: `use_triangle_simd`, or `use_triangle_fixed_point`");
+            if (pipeline_configuration.use_triangle_simd) break :blk rasterizers.rasterize_simd;
+            if (pipeline_configuration.use_triangle_fixed_point) break :blk rasterizers.rasterize_fixed_point;
+            if (pipeline_configuration.use_triangle_2) break :blk rasterizers.rasterize_2;
+            break :blk rasterizers.rasterize_1;
+        };
         const rasterizers = struct {
-            fn rasterize_2(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type) void {
+            fn rasterize_2(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type, triangle_id: u32) void {
                 
                 const a = &tri[0];
                 const b = &tri[1];
                 const c = &tri[2];
 
+                const attributes = AttributePlanes.from(invariants, w_used_for_perspective_correction);
+
                 var top: *const Vector3f = &tri[0];
                 var mid: *const Vector3f = &tri[1];
                 var bot: *const Vector3f = &tri[2];
@@ -405,7 +948,8 @@ pub fn GraphicsPipeline(
 
                     // draw top half
                     var y: usize = @intFromFloat(top.y);
-                    while (y > @as(usize, @intFromFloat(mid.y))) : (y -= 1) {
+                    while (y > @as(usize, @intFromFloat(mid.y))) : ({ y -= 1; side1 -= incrementLongLine; side2 -= incrementShortLine; }) {
+                        if (y < region.bottom or y >= region.top) continue;
                         
                         // TODO I can probably skip doing this on every line and just do it once
                         var left: usize = @intFromFloat(side1);
@@ -416,9 +960,9 @@ pub fn GraphicsPipeline(
                             right = aux;
                         }
                         
-                        var x: usize = left;
+                        var x: usize = @max(left, region.left);
                         // draw a horizontal line from left to right
-                        while (x < right) : (x += 1) {
+                        while (x < @min(right, region.right)) : (x += 1) {
                             
                             // barycentric coordinates of the current pixel
                             const pixel = Vector3f { .x = @floatFromInt(x), .y = @floatFromInt(y), .z = 0 };
@@ -448,25 +992,11 @@ pub fn GraphicsPipeline(
 
                             if (pipeline_configuration.do_depth_testing) {
                                 const z = depth[0] * w + depth[1] * u + depth[2] * v;
-                                if (requirements.depth_buffer.get(x, y) < z) continue;
-                                requirements.depth_buffer.set(x, y, z);
+                                if (!depth_test(requirements, x, y, z)) continue;
                             }
 
-                            const interpolated_invariants: invariant_type = 
-                                if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(invariant_type, invariants, w_used_for_perspective_correction, u, v, w)
-                                else interpolate(invariant_type, invariants, u, v, w);
-
-                            const final_color = fragment_shader(context, interpolated_invariants);
-                            
-                            if (pipeline_configuration.blend_with_background) {
-                                const old_color = pixel_buffer.get(x, y);
-                                pixel_buffer.set(x, y, final_color.blend(old_color));
-                            }
-                            else pixel_buffer.set(x, y, final_color);
+                            shade_fragment(pixel_buffer, context, requirements, x, y, triangle_id, attributes, u, v);
                         }
-
-                        side1 -= incrementLongLine;
-                        side2 -= incrementShortLine;
                     }
 
                 }
@@ -479,7 +1009,8 @@ pub fn GraphicsPipeline(
 
                     // draw bottom half
                     var y: usize = @intFromFloat(mid.y);
-                    while (y > @as(usize, @intFromFloat(bot.y))) : (y -= 1) {
+                    while (y > @as(usize, @intFromFloat(bot.y))) : ({ y -= 1; side1 -= incrementLongLine; side2 -= incrementShortLine; }) {
+                        if (y < region.bottom or y >= region.top) continue;
                         
                         // TODO I can probably skip doing this on every line and just do it once
                         var left: usize = @intFromFloat(side1);
@@ -490,9 +1021,9 @@ pub fn GraphicsPipeline(
                             right = aux;
                         }
                         
-                        var x: usize = left;
+                        var x: usize = @max(left, region.left);
                         // draw a horizontal line from left to right
-                        while (x < right) : (x += 1) {
+                        while (x < @min(right, region.right)) : (x += 1) {
                             
                             // barycentric coordinates of the current pixel
                             const pixel = Vector3f { .x = @floatFromInt(x), .y = @floatFromInt(y), .z = 0 };
@@ -522,25 +1053,11 @@ pub fn GraphicsPipeline(
 
                             if (pipeline_configuration.do_depth_testing) {
                                 const z = depth[0] * w + depth[1] * u + depth[2] * v;
-                                if (requirements.depth_buffer.get(x, y) < z) continue;
-                                requirements.depth_buffer.set(x, y, z);
+                                if (!depth_test(requirements, x, y, z)) continue;
                             }
 
-                            const interpolated_invariants: invariant_type = 
-                                if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(invariant_type, invariants, w_used_for_perspective_correction, u, v, w)
-                                else interpolate(invariant_type, invariants, u, v, w);
-
-                            const final_color = fragment_shader(context, interpolated_invariants);
-                            
-                            if (pipeline_configuration.blend_with_background) {
-                                const old_color = pixel_buffer.get(x, y);
-                                pixel_buffer.set(x, y, final_color.blend(old_color));
-                            }
-                            else pixel_buffer.set(x, y, final_color);
+                            shade_fragment(pixel_buffer, context, requirements, x, y, triangle_id, attributes, u, v);
                         }
-
-                        side1 -= incrementLongLine;
-                        side2 -= incrementShortLine;
                     }
                 }
 
@@ -550,7 +1067,7 @@ pub fn GraphicsPipeline(
                     // TODO draw a line from left to right. figure out which side is mor to the left and which one is more to the right
                 }
             }
-            fn rasterize_1(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type) void {
+            fn rasterize_1(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type, triangle_id: u32) void {
                 
                 trace("rasterize_1", .{});
                 trace_triangle(tri);
@@ -566,29 +1083,18 @@ pub fn GraphicsPipeline(
                 const ca = a.substract(c.*);
                 const paralelogram_area_abc: f32 = ab.cross_product(ac).z;
                 if (paralelogram_area_abc < std.math.floatEps(f32)) return;
+                const attributes = AttributePlanes.from(invariants, w_used_for_perspective_correction);
 
-                // calculate the bounds in pixels of the triangle on the screen
-                var left: usize = @intFromFloat(@min(a.x, @min(b.x, c.x)));
-                var bottom: usize = @intFromFloat(@min(a.y, @min(b.y, c.y)));
-                var right: usize = @intFromFloat(@max(a.x, @max(b.x, c.x)));
-                var top: usize = @intFromFloat(@max(a.y, @max(b.y, c.y)));
-
-                if (pipeline_configuration.do_scissoring) {
-                    left = @min(left, @as(usize, @intFromFloat(requirements.scissor_rect.x)));
-                    bottom = @min(bottom, @as(usize, @intFromFloat(requirements.scissor_rect.y)));
-                    right = @max(right, @as(usize, @intFromFloat(requirements.scissor_rect.z)));
-                    top = @max(top, @as(usize, @intFromFloat(requirements.scissor_rect.w)));
-                }
-
-                trace_bb(left, right, top, bottom);
+                const bounds = pixel_bounds(requirements, region, tri) orelse return;
+                trace_bb(bounds.left, bounds.right, bounds.top, bounds.bottom);
 
                 // bottom to top
-                var y: usize = bottom;
-                while (y <= top) : (y += 1) {
+                var y: usize = bounds.bottom;
+                while (y < bounds.top) : (y += 1) {
                     
                     // left to right
-                    var x: usize = left;
-                    while (x <= right) : (x += 1) {
+                    var x: usize = bounds.left;
+                    while (x < bounds.right) : (x += 1) {
                         
                         // calculate barycentric coordinates of the current pixel
                         // NOTE we are checking that THE MIDDLE point of the pixel itself is inside the triangle, hence the +0.5
@@ -616,25 +1122,419 @@ pub fn GraphicsPipeline(
                             // if (pipeline_configuration.do_perspective_correct_interpolation) {}
                             // else {}
                             const z = depth[0] * w + depth[1] * u + depth[2] * v;
-                            if (requirements.depth_buffer.get(x, y) < z) continue;
-                            requirements.depth_buffer.set(x, y, z);
+                            if (!depth_test(requirements, x, y, z)) continue;
+                        }
+
+                        shade_fragment(pixel_buffer, context, requirements, x, y, triangle_id, attributes, u, v);
+
+                    }
+                }
+            }
+            /// Same coverage rules as `rasterize_1`, but rather than calculating the barycentric coordinates of every pixel from scratch,
+            /// the edge functions are set up once per triangle and stepped incrementally, evaluating the coverage, depth and barycentric
+            /// coordinates of 8 pixels at a time. Only the covered pixels go through the depth test and the fragment shader.
+            fn rasterize_simd(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type, triangle_id: u32) void {
+                
+                trace("rasterize_simd", .{});
+                trace_triangle(tri);
+
+                const lanes = 8;
+                const VF = @Vector(lanes, f32);
+                const VI = @Vector(lanes, i32);
+                const VB = @Vector(lanes, bool);
+
+                const a = &tri[0];
+                const b = &tri[1];
+                const c = &tri[2];
+
+                const ab = b.substract(a.*);
+                const ac = c.substract(a.*);
+                const ca = a.substract(c.*);
+                const paralelogram_area_abc: f32 = ab.cross_product(ac).z;
+                if (paralelogram_area_abc < std.math.floatEps(f32)) return;
+                const attributes = AttributePlanes.from(invariants, w_used_for_perspective_correction);
+
+                const bounds = pixel_bounds(requirements, region, tri) orelse return;
+                trace_bb(bounds.left, bounds.right, bounds.top, bounds.bottom);
+
+                // `u` and `v` are the z of the cross products `ca x ap` and `ab x bp` (same as in `rasterize_1`) divided by the area of `abc`.
+                // Both are linear in the position of the pixel, so they can be written as `origin + x * dx + y * dy`.
+                // They are evaluated at the absolute position of every row and block rather than stepped from the corner of the bounds, and the
+                // blocks are aligned to multiples of 8 pixels, so a pixel gets the same values no matter which region it is rasterized in
+                // (a tile of `use_multithreading` or a span of `do_hierarchical_depth_testing`)
+                const inverse_area = 1 / paralelogram_area_abc;
+                const u_dx = -ca.y * inverse_area;
+                const u_dy = ca.x * inverse_area;
+                const v_dx = -ab.y * inverse_area;
+                const v_dy = ab.x * inverse_area;
+                // NOTE we are checking that THE MIDDLE point of the pixel itself is inside the triangle, hence the 0.5
+                const u_origin = (ca.x * (0.5 - a.y) - ca.y * (0.5 - a.x)) * inverse_area;
+                const v_origin = (ab.x * (0.5 - b.y) - ab.y * (0.5 - b.x)) * inverse_area;
+
+                const lane_offsets = VF { 0, 1, 2, 3, 4, 5, 6, 7 };
+                const lane_indices = VI { 0, 1, 2, 3, 4, 5, 6, 7 };
+                const u_lanes: VF = @splat(u_dx);
+                const v_lanes: VF = @splat(v_dx);
+                const zero: VF = @splat(0);
+                const one: VF = @splat(1);
+                const none: VB = @splat(false);
+                const depth_a: VF = @splat(depth[0]);
+                const depth_b: VF = @splat(depth[1]);
+                const depth_c: VF = @splat(depth[2]);
+                const left: VI = @splat(@intCast(bounds.left));
+                const right: VI = @splat(@intCast(bounds.right));
+                const first_block_x = bounds.left - bounds.left % lanes;
+
+                // bottom to top
+                var y: usize = bounds.bottom;
+                while (y < bounds.top) : (y += 1) {
+                    
+                    const y_float: f32 = @floatFromInt(y);
+                    const u_row: VF = @splat(u_origin + y_float * u_dy);
+                    const v_row: VF = @splat(v_origin + y_float * v_dy);
+
+                    // left to right, 8 pixels at a time
+                    var x: usize = first_block_x;
+                    while (x < bounds.right) : (x += lanes) {
+                        
+                        const x_lanes: VF = @as(VF, @splat(@floatFromInt(x))) + lane_offsets;
+                        const u: VF = u_row + x_lanes * u_lanes;
+                        const v: VF = v_row + x_lanes * v_lanes;
+                        const w: VF = one - u - v;
+                        
+                        // determine which pixels are in fact part of the triangle (and inside of the bounds)
+                        const pixel_x: VI = @as(VI, @splat(@intCast(x))) + lane_indices;
+                        var covered: VB = pixel_x >= left;
+                        covered = @select(bool, covered, pixel_x < right, none);
+                        covered = @select(bool, covered, @min(u, @min(v, w)) >= zero, none);
+                        covered = @select(bool, covered, @max(u, @max(v, w)) < one, none);
+                        if (!@reduce(.Or, covered)) continue;
+
+                        const z: VF = if (pipeline_configuration.do_depth_testing) depth_a * w + depth_b * u + depth_c * v else undefined;
+                        const z_array: [lanes]f32 = z;
+                        if (pipeline_configuration.do_depth_testing) {
+                            // if the whole block is inside of the bounds, early out if all 8 pixels fail the depth test.
+                            // Only ever load the depths inside of the bounds, the rest might belong to a tile being rasterized by another thread
+                            if (x >= bounds.left and x + lanes <= bounds.right) {
+                                const VD = @Vector(lanes, pipeline_configuration.depth_format.Type());
+                                const stored_depth: VD = requirements.depth_buffer.data[x + requirements.depth_buffer.width * y ..][0..lanes].*;
+                                const encoded_z: VD = if (pipeline_configuration.depth_format == .float32) z else blk: {
+                                    var encoded: [lanes]pipeline_configuration.depth_format.Type() = undefined;
+                                    for (&encoded, z_array) |*e, lane_z| e.* = encode_depth(lane_z);
+                                    break :blk encoded;
+                                };
+                                if (!@reduce(.Or, @select(bool, covered, depth_passes(stored_depth, encoded_z), none))) continue;
+                            }
                         }
 
-                        const interpolated_invariants: invariant_type = 
-                            if (pipeline_configuration.do_perspective_correct_interpolation) interpolate_with_correction(invariant_type, invariants, w_used_for_perspective_correction, u, v, w)
-                            else interpolate(invariant_type, invariants, u, v, w);
+                        const covered_array: [lanes]bool = covered;
+                        const u_array: [lanes]f32 = u;
+                        const v_array: [lanes]f32 = v;
+                        for (0..lanes) |lane| {
+                            if (!covered_array[lane]) continue;
+                            const lane_x = x + lane;
 
-                        const final_color = fragment_shader(context, interpolated_invariants);
+                            if (pipeline_configuration.do_depth_testing) {
+                                if (!depth_test(requirements, lane_x, y, z_array[lane])) continue;
+                            }
+
+                            shade_fragment(pixel_buffer, context, requirements, lane_x, y, triangle_id, attributes, u_array[lane], v_array[lane]);
+                        }
+                    }
+                }
+            }
+            /// Snaps the vertices to a grid of `1 << subpixel_bits` subpixels per pixel (28.4 fixed point by default) and walks exact integer
+            /// edge functions. Pixel centers which land exactly on an edge only belong to the triangle if the edge is a top or a left edge,
+            /// so two triangles sharing an edge never both cover (or both miss) a pixel along it.
+            fn rasterize_fixed_point(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type, triangle_id: u32) void {
+                
+                trace("rasterize_fixed_point", .{});
+                trace_triangle(tri);
+
+                const subpixel_bits = pipeline_configuration.subpixel_bits;
+                if (subpixel_bits > GraphicsPipelineConfiguration.max_subpixel_bits) @compileError("`subpixel_bits` can't be bigger than `max_subpixel_bits`");
+                const subpixels_per_pixel: i64 = 1 << subpixel_bits;
+                const half_pixel: i64 = subpixels_per_pixel / 2;
+
+                // snap the vertices to the subpixel grid
+                const a = snap_to_subpixel(tri[0], subpixel_bits);
+                const b = snap_to_subpixel(tri[1], subpixel_bits);
+                const c = snap_to_subpixel(tri[2], subpixel_bits);
+
+                // same convention as the other rasterizers: only counter clockwise triangles (with some area) are rasterized
+                const area: i64 = edge_function(a, b, c);
+                if (area <= 0) return;
+
+                const bounds = pixel_bounds(requirements, region, tri) orelse return;
+                trace_bb(bounds.left, bounds.right, bounds.top, bounds.bottom);
+
+                // The edge function of the edge `from -> to` at `p` is `(to.x - from.x) * (p.y - from.y) - (to.y - from.y) * (p.x - from.x)`
+                // and is positive for points at the left of the edge, which for a counter clockwise triangle means inside of it.
+                // Since it is linear, moving a pixel to the right adds `-(to.y - from.y) * subpixels_per_pixel` and moving a pixel up adds `(to.x - from.x) * subpixels_per_pixel`.
+                // The edge which is opposite to a vertex gives the weight of that vertex: `w` for `a`, `u` for `b` and `v` for `c`.
+                const first = SubpixelPoint {
+                    .x = @as(i64, @intCast(bounds.left)) * subpixels_per_pixel + half_pixel,
+                    .y = @as(i64, @intCast(bounds.bottom)) * subpixels_per_pixel + half_pixel,
+                };
+                const edges = [3]struct { from: SubpixelPoint, to: SubpixelPoint } { .{ .from = b, .to = c }, .{ .from = c, .to = a }, .{ .from = a, .to = b } };
+                var row: [3]i64 = undefined;
+                var step_x: [3]i64 = undefined;
+                var step_y: [3]i64 = undefined;
+                inline for (edges, 0..) |edge, i| {
+                    const dx = edge.to.x - edge.from.x;
+                    const dy = edge.to.y - edge.from.y;
+                    // top-left rule: in a counter clockwise triangle (with y going up) the left edges go down and the top edges go left.
+                    // Pixels exactly on any other edge are not part of the triangle, which is what the -1 bias does to the integer edge function.
+                    const is_top_left = dy < 0 or (dy == 0 and dx < 0);
+                    const bias: i64 = if (is_top_left) 0 else -1;
+                    row[i] = edge_function(edge.from, edge.to, first) + bias;
+                    step_x[i] = -dy * subpixels_per_pixel;
+                    step_y[i] = dx * subpixels_per_pixel;
+                }
+                // undo the bias when calculating the barycentric coordinates
+                const bias_w: i64 = row[0] - edge_function(b, c, first);
+                const bias_u: i64 = row[1] - edge_function(c, a, first);
+                const bias_v: i64 = row[2] - edge_function(a, b, first);
+                const inverse_area: f32 = 1 / @as(f32, @floatFromInt(area));
+                const attributes = AttributePlanes.from(invariants, w_used_for_perspective_correction);
+
+                // bottom to top
+                var y: usize = bounds.bottom;
+                while (y < bounds.top) : ({ y += 1; row[0] += step_y[0]; row[1] += step_y[1]; row[2] += step_y[2]; }) {
+                    
+                    // left to right
+                    var edge_w = row[0];
+                    var edge_u = row[1];
+                    var edge_v = row[2];
+                    var x: usize = bounds.left;
+                    while (x < bounds.right) : ({ x += 1; edge_w += step_x[0]; edge_u += step_x[1]; edge_v += step_x[2]; }) {
                         
-                        if (pipeline_configuration.blend_with_background) {
-                            const old_color = pixel_buffer.get(x, y);
-                            pixel_buffer.set(x, y, final_color.blend(old_color));
+                        // determine if a pixel is in fact part of the triangle: none of the (biased) edge functions can be negative
+                        if ((edge_w | edge_u | edge_v) < 0) continue;
+
+                        // The inverse of the barycentric would be `P=wA+uB+vC`
+                        const u: f32 = @as(f32, @floatFromInt(edge_u - bias_u)) * inverse_area;
+                        const v: f32 = @as(f32, @floatFromInt(edge_v - bias_v)) * inverse_area;
+                        const w: f32 = @as(f32, @floatFromInt(edge_w - bias_w)) * inverse_area;
+
+                        if (pipeline_configuration.do_depth_testing) {
+                            const z = depth[0] * w + depth[1] * u + depth[2] * v;
+                            if (!depth_test(requirements, x, y, z)) continue;
                         }
-                        else pixel_buffer.set(x, y, final_color);
 
+                        shade_fragment(pixel_buffer, context, requirements, x, y, triangle_id, attributes, u, v);
+                    }
+                }
+            }
+            const SubpixelPoint = struct {
+                x: i64,
+                y: i64,
+            };
+            inline fn snap_to_subpixel(point: Vector3f, comptime subpixel_bits: u5) SubpixelPoint {
+                const scale: f32 = comptime @floatFromInt(1 << subpixel_bits);
+                return .{ .x = @intFromFloat(@round(point.x * scale)), .y = @intFromFloat(@round(point.y * scale)) };
+            }
+            /// z of the cross product `(to - from) x (p - from)`
+            inline fn edge_function(from: SubpixelPoint, to: SubpixelPoint, p: SubpixelPoint) i64 {
+                return (to.x - from.x) * (p.y - from.y) - (to.y - from.y) * (p.x - from.x);
+            }
+            /// Walks the 8x8 blocks of the hierarchical depth buffer overlapped by the triangle and skips the ones where the nearest
+            /// depth of the triangle is behind everything already drawn. Every horizontal run of blocks which can't be skipped is
+            /// rasterized as a single region by `triangle_rasterizer`, so a fully occluded triangle never reaches the pixel loops.
+            fn rasterize_hierarchical_depth_culled(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type, triangle_id: u32) void {
+                const block_size = HierarchicalDepthBuffer.block_size;
+                // the coarse blocks must not be shared by tiles, since tiles are rasterized in parallel
+                if (pipeline_configuration.use_multithreading and pipeline_configuration.multithreading_tile_size % HierarchicalDepthBuffer.coarse_block_size != 0) @compileError("`multithreading_tile_size` must be a multiple of 64 when using `do_hierarchical_depth_testing`");
+                const hierarchical_depth_buffer = requirements.hierarchical_depth_buffer;
+                const nearest_depth = @min(depth[0], @min(depth[1], depth[2]));
+                const bounds = conservative_bounds(region, tri) orelse return;
+
+                const first_block_x = bounds.left / block_size;
+                const last_block_x = (bounds.right - 1) / block_size + 1;
+                const first_block_y = bounds.bottom / block_size;
+                const last_block_y = (bounds.top - 1) / block_size + 1;
+                for (first_block_y..last_block_y) |block_y| {
+                    var block_x = first_block_x;
+                    while (block_x < last_block_x) {
+                        if (hierarchical_depth_buffer.is_occluded(block_x, block_y, nearest_depth)) {
+                            block_x += 1;
+                            continue;
+                        }
+                        // `block_x` was just tested, test (and possibly refresh) each block only once
+                        const first_visible_block_x = block_x;
+                        block_x += 1;
+                        while (block_x < last_block_x and !hierarchical_depth_buffer.is_occluded(block_x, block_y, nearest_depth)) block_x += 1;
+                        const span = Region {
+                            .left = @max(bounds.left, first_visible_block_x * block_size),
+                            .bottom = @max(bounds.bottom, block_y * block_size),
+                            .right = @min(bounds.right, block_x * block_size),
+                            .top = @min(bounds.top, (block_y + 1) * block_size),
+                        };
+                        triangle_rasterizer(pixel_buffer, context, requirements, span, tri, depth, w_used_for_perspective_correction, invariants, triangle_id);
+                        for (first_visible_block_x..block_x) |visible_block_x| hierarchical_depth_buffer.mark_dirty(visible_block_x, block_y);
                     }
                 }
             }
+            /// Fills the tiles of the lazily cleared buffers which the triangle might touch, right before rasterizing it.
+            /// Tiles never get shared by the regions of `use_multithreading`, so preparing them needs no locking
+            fn rasterize_lazily_cleared(pixel_buffer: Buffer2D(final_color_type), context: context_type, requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f, depth: [3]f32, w_used_for_perspective_correction: [3]f32, invariants: [3]invariant_type, triangle_id: u32) void {
+                if (pipeline_configuration.use_multithreading and pipeline_configuration.multithreading_tile_size % LazyClear.tile_size != 0) @compileError("`multithreading_tile_size` must be a multiple of 32 when using `use_lazy_clear`");
+                const bounds = conservative_bounds(region, tri) orelse return;
+                for (requirements.lazy_clears) |lazy_clear| lazy_clear.prepare(bounds.left, bounds.bottom, bounds.right, bounds.top);
+                culling_rasterizer(pixel_buffer, context, requirements, region, tri, depth, w_used_for_perspective_correction, invariants, triangle_id);
+            }
+            /// The bounds in pixels of the triangle limited to the `region`, grown by a pixel on every side since not every rasterizer
+            /// agrees on which pixels the edges touch. Null if they don't overlap
+            fn conservative_bounds(region: Region, tri: [3]Vector3f) ?Region {
+                return conservative_box_bounds(
+                    region,
+                    .{ .x = @min(tri[0].x, @min(tri[1].x, tri[2].x)), .y = @min(tri[0].y, @min(tri[1].y, tri[2].y)) },
+                    .{ .x = @max(tri[0].x, @max(tri[1].x, tri[2].x)), .y = @max(tri[0].y, @max(tri[1].y, tri[2].y)) },
+                );
+            }
+            /// same as `conservative_bounds` for the box from `min` to `max`
+            fn conservative_box_bounds(region: Region, min: Vector2f, max: Vector2f) ?Region {
+                const min_x = min.x - 1;
+                const min_y = min.y - 1;
+                const max_x = max.x + 1;
+                const max_y = max.y + 1;
+                if (max_x < @as(f32, @floatFromInt(region.left)) or max_y < @as(f32, @floatFromInt(region.bottom))) return null;
+                if (min_x >= @as(f32, @floatFromInt(region.right)) or min_y >= @as(f32, @floatFromInt(region.top))) return null;
+                return Region {
+                    .left = @max(region.left, @as(usize, @intFromFloat(@max(min_x, 0)))),
+                    .bottom = @max(region.bottom, @as(usize, @intFromFloat(@max(min_y, 0)))),
+                    .right = @as(usize, @intFromFloat(@min(max_x, @as(f32, @floatFromInt(region.right - 1))))) + 1,
+                    .top = @as(usize, @intFromFloat(@min(max_y, @as(f32, @floatFromInt(region.top - 1))))) + 1,
+                };
+            }
+            /// returns the bounds in pixels of the triangle on the screen, limited to the `region` being rasterized, or null if there is nothing to rasterize
+            fn pixel_bounds(requirements: pipeline_configuration.Requirements(), region: Region, tri: [3]Vector3f) ?Region {
+                const a = &tri[0];
+                const b = &tri[1];
+                const c = &tri[2];
+                const min_x = @max(@min(a.x, @min(b.x, c.x)), @as(f32, @floatFromInt(region.left)));
+                const min_y = @max(@min(a.y, @min(b.y, c.y)), @as(f32, @floatFromInt(region.bottom)));
+                const max_x = @min(@max(a.x, @max(b.x, c.x)), @as(f32, @floatFromInt(region.right - 1)));
+                const max_y = @min(@max(a.y, @max(b.y, c.y)), @as(f32, @floatFromInt(region.top - 1)));
+                if (min_x > max_x or min_y > max_y) return null;
+                var left: usize = @intFromFloat(min_x);
+                var bottom: usize = @intFromFloat(min_y);
+                var right: usize = @intFromFloat(max_x);
+                var top: usize = @intFromFloat(max_y);
+
+                if (pipeline_configuration.do_scissoring) {
+                    left = @max(region.left, @min(left, @as(usize, @intFromFloat(requirements.scissor_rect.x))));
+                    bottom = @max(region.bottom, @min(bottom, @as(usize, @intFromFloat(requirements.scissor_rect.y))));
+                    right = @min(region.right - 1, @max(right, @as(usize, @intFromFloat(requirements.scissor_rect.z))));
+                    top = @min(region.top - 1, @max(top, @as(usize, @intFromFloat(requirements.scissor_rect.w))));
+                }
+
+                return Region { .left = left, .bottom = bottom, .right = right + 1, .top = top + 1 };
+            }
+        };
+
+        /// `invariant_type` flattened at comptime into the lanes of a single vector, so that every attribute of a pixel is interpolated at once.
+        /// Every float and int gets a lane, and so does every float and int of its inner structs (in declaration order).
+        /// With `do_perspective_correct_interpolation` the last lane is used for `1/w`.
+        const flat_invariants = struct {
+
+            const attribute_count = count: {
+                var count: usize = 0;
+                for (@typeInfo(invariant_type).Struct.fields) |field| {
+                    switch (@typeInfo(field.type)) {
+                        .Float, .Int => count += 1,
+                        .Struct => |s| count += s.fields.len,
+                        else => @compileError("invariant " ++ field.name ++ " is neither a Float, Int or Struct so it cant be interpolated!"),
+                    }
+                }
+                break :count count;
+            };
+            const lanes = @max(1, if (pipeline_configuration.do_perspective_correct_interpolation) attribute_count + 1 else attribute_count);
+            const Flat = @Vector(lanes, f32);
+
+            inline fn to_lane(value: anytype) f32 {
+                return switch (@typeInfo(@TypeOf(value))) {
+                    .Float => @floatCast(value),
+                    .Int => @floatFromInt(value),
+                    else => @compileError("inner struct type " ++ @typeName(@TypeOf(value)) ++ " is neither a Float, Int so it cant be interpolated!"),
+                };
+            }
+
+            inline fn from_lane(comptime T: type, lane: f32) T {
+                return switch (@typeInfo(T)) {
+                    .Float => @floatCast(lane),
+                    .Int => @intFromFloat(lane),
+                    else => unreachable,
+                };
+            }
+
+            inline fn pack(invariants: invariant_type) Flat {
+                var result: [lanes]f32 = undefined;
+                comptime var lane: usize = 0;
+                inline for (@typeInfo(invariant_type).Struct.fields) |field| {
+                    const value = @field(invariants, field.name);
+                    switch (@typeInfo(field.type)) {
+                        .Struct => |s| inline for (s.fields) |sub_field| {
+                            result[lane] = to_lane(@field(value, sub_field.name));
+                            lane += 1;
+                        },
+                        else => {
+                            result[lane] = to_lane(value);
+                            lane += 1;
+                        },
+                    }
+                }
+                if (pipeline_configuration.do_perspective_correct_interpolation) result[lanes - 1] = 1;
+                return result;
+            }
+
+            inline fn unpack(flat: Flat) invariant_type {
+                const flat_array: [lanes]f32 = flat;
+                var result: invariant_type = undefined;
+                comptime var lane: usize = 0;
+                inline for (@typeInfo(invariant_type).Struct.fields) |field| {
+                    switch (@typeInfo(field.type)) {
+                        .Struct => |s| inline for (s.fields) |sub_field| {
+                            @field(@field(result, field.name), sub_field.name) = from_lane(sub_field.type, flat_array[lane]);
+                            lane += 1;
+                        },
+                        else => {
+                            @field(result, field.name) = from_lane(field.type, flat_array[lane]);
+                            lane += 1;
+                        },
+                    }
+                }
+                return result;
+            }
+        };
+
+        /// The plane equations of every attribute of a triangle, set up once per triangle, in terms of the barycentric coordinates `u` and `v`
+        /// (which are themselves linear in screen space). Getting the invariants of a pixel is then a couple of vector multiply-adds,
+        /// rather than going field by field through `interpolate` and dividing by `w` per attribute.
+        const AttributePlanes = struct {
+            origin: flat_invariants.Flat,
+            d_u: flat_invariants.Flat,
+            d_v: flat_invariants.Flat,
+
+            inline fn from(invariants: [3]invariant_type, w_used_for_perspective_correction: [3]f32) AttributePlanes {
+                var a = flat_invariants.pack(invariants[0]);
+                var b = flat_invariants.pack(invariants[1]);
+                var c = flat_invariants.pack(invariants[2]);
+                if (pipeline_configuration.do_perspective_correct_interpolation) {
+                    // interpolate `attribute/w` and `1/w` (the last lane) linearly, and divide them back per pixel
+                    a /= @as(flat_invariants.Flat, @splat(w_used_for_perspective_correction[0]));
+                    b /= @as(flat_invariants.Flat, @splat(w_used_for_perspective_correction[1]));
+                    c /= @as(flat_invariants.Flat, @splat(w_used_for_perspective_correction[2]));
+                }
+                return .{ .origin = a, .d_u = b - a, .d_v = c - a };
+            }
+
+            /// the invariants at the point with barycentric coordinates `u` and `v`, where `P=wA+uB+vC`
+            inline fn at(self: AttributePlanes, u: f32, v: f32) invariant_type {
+                var flat = self.origin + self.d_u * @as(flat_invariants.Flat, @splat(u)) + self.d_v * @as(flat_invariants.Flat, @splat(v));
+                if (pipeline_configuration.do_perspective_correct_interpolation) flat /= @as(flat_invariants.Flat, @splat(flat[flat_invariants.lanes - 1]));
+                return flat_invariants.unpack(flat);
+            }
         };
 
         /// Here, `t` could be any struct that consists of either floats, ints, or structs.
@@ -682,135 +1582,539 @@ pub fn GraphicsPipeline(
             return interpolated_data;
         }
 
-        /// Same as `interpolate` but applies perspective correction using the provided correction_values
-        /// Here, `t` could be any struct that consists of either floats, ints, or structs.
-        /// Structs MUST in turn be composed of all floats or all ints
-        /// ex: struct { a: f32, b: Vector2f, c: RGBA }
-        /// NOTE I'm assuming that the order of fields inside a struct is kept... which is probably not true in some situations???? but it works for now
-        fn interpolate_with_correction(comptime t: type, data: [3]t, correction_values: [3]f32, u: f32, v: f32, w: f32) t {
-            
-            var interpolated_data: t = undefined;
+        fn trace_bb(left: usize, right: usize, top: usize, bottom: usize) void {
+            trace("T.BB: left {}, right {}, top {}, bottom {}", .{left, right, top, bottom});
+        }
 
-            const correction = 1/correction_values[0] * w + 1/correction_values[1] * u + 1/correction_values[2] * v;
+        fn trace_triangle(t: [3]Vector3f) void {
+            trace("T.A: {d:.8}, {d:.8}, {d:.8}", .{t[0].x,t[0].y,t[0].z});
+            trace("T.B: {d:.8}, {d:.8}, {d:.8}", .{t[1].x,t[1].y,t[1].z});
+            trace("T.C: {d:.8}, {d:.8}, {d:.8}", .{t[2].x,t[2].y,t[2].z});
+        }
 
-            inline for (@typeInfo(t).Struct.fields) |field| {
-                @field(interpolated_data, field.name) = interpolate_field: {
-                    
-                    const a: *const field.type = &@field(data[0], field.name);
-                    const b: *const field.type = &@field(data[1], field.name);
-                    const c: *const field.type = &@field(data[2], field.name);
-                    const interpolated_result: field.type = switch (@typeInfo(field.type)) {
-                        .Float => blk: {
-                            const fa: f32 = a.* / correction_values[0];
-                            const fb: f32 = b.* / correction_values[1];
-                            const fc: f32 = c.* / correction_values[2];
-                            break :blk (fa * w + fb * u + fc * v) / correction;
-                        },
-                        .Int => blk: {
-                            const fa: f32 = @as(f32, @floatFromInt(a.*)) / correction_values[0];
-                            const fb: f32 = @as(f32, @floatFromInt(b.*)) / correction_values[1];
-                            const fc: f32 = @as(f32, @floatFromInt(c.*)) / correction_values[2];
-                            const result = (fa * w + fb * u + fc * v) / correction;
-                            break :blk @intFromFloat(result);
-                        },
-                        .Struct => |s| interpolate_struct: {
-                            
-                            var interpolated_struct_result: field.type = undefined;
-                            inline for (s.fields) |sub_field| {
-                                @field(interpolated_struct_result, sub_field.name) = interpolate_struct_field: {
-                                    
-                                    const sub_a: *const sub_field.type = &@field(a, sub_field.name);
-                                    const sub_b: *const sub_field.type = &@field(b, sub_field.name);
-                                    const sub_c: *const sub_field.type = &@field(c, sub_field.name);
-                                    break :interpolate_struct_field switch (@typeInfo(sub_field.type)) {
-                                        .Float => blk: {
-                                            const fa: f32 = sub_a.* / correction_values[0];
-                                            const fb: f32 = sub_b.* / correction_values[1];
-                                            const fc: f32 = sub_c.* / correction_values[2];
-                                            break :blk (fa * w + fb * u + fc * v) / correction;
-                                        },
-                                        .Int => blk: {
-                                            const fa: f32 = @as(f32, @floatFromInt(sub_a.*)) / correction_values[0];
-                                            const fb: f32 = @as(f32, @floatFromInt(sub_b.*)) / correction_values[1];
-                                            const fc: f32 = @as(f32, @floatFromInt(sub_c.*)) / correction_values[2];
-                                            const result = (fa * w + fb * u + fc * v) / correction;
-                                            break :blk @intFromFloat(result);
-                                        },
-                                        else => @panic("inner struct type " ++ @tagName(sub_field.type) ++ " is neither a Float, Int so it cant be interpolated!")
-                                    };
-                                };
-                            }
-                            break :interpolate_struct interpolated_struct_result;
+        fn trace(comptime fmt: []const u8, args: anytype) void {
+            if (!pipeline_configuration.trace) return;
+            std.log.debug(fmt, args);
+        }
 
-                        },
-                        else => @panic("type " ++ @tagName(field.type) ++ " is neither a Float, Int or Struct, so it cant be interpolated!")
-                    };
+    };
+}
 
-                    break :interpolate_field interpolated_result;
-                };
-            }
+test "use_multithreading renders the same as the serial path" {
+    const RGBA = pixels.RGBA;
+    const Context = struct {};
+    const Invariant = struct { color: Vector3f };
+    const Vertex = struct { position: Vector3f, color: Vector3f };
+    const Rasterizer = enum { rasterize_1, rasterize_2, simd, fixed_point };
+    const width = 40;
+    const height = 30;
+    const vertices = [_]Vertex {
+        .{ .position = Vector3f.from(-0.9, -0.8, 0.5), .color = Vector3f.from(1, 0, 0) },
+        .{ .position = Vector3f.from(0.7, -0.6, 0.5), .color = Vector3f.from(0, 1, 0) },
+        .{ .position = Vector3f.from(-0.2, 0.9, 0.5), .color = Vector3f.from(0, 0, 1) },
+        .{ .position = Vector3f.from(-0.5, -0.9, 0.2), .color = Vector3f.from(1, 1, 0) },
+        .{ .position = Vector3f.from(0.95, 0.1, 0.8), .color = Vector3f.from(0, 1, 1) },
+        .{ .position = Vector3f.from(-0.7, 0.6, 0.4), .color = Vector3f.from(1, 0, 1) },
+        .{ .position = Vector3f.from(0.1, -0.95, 0.9), .color = Vector3f.from(0.2, 0.4, 0.6) },
+        .{ .position = Vector3f.from(0.9, 0.9, 0.1), .color = Vector3f.from(0.9, 0.1, 0.5) },
+        .{ .position = Vector3f.from(-0.95, 0.3, 0.6), .color = Vector3f.from(0.3, 0.8, 0.2) },
+    };
+    const scene = struct {
+        fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector4f {
+            _ = context;
+            out_invariant.color = vertex.color;
+            return Vector4f.from(vertex.position.x, vertex.position.y, vertex.position.z, 1);
+        }
+        fn fragment_shader(context: Context, invariants: Invariant) RGBA {
+            _ = context;
+            return RGBA.make(to_byte(invariants.color.x), to_byte(invariants.color.y), to_byte(invariants.color.z), 255);
+        }
+        fn to_byte(channel: f32) u8 {
+            return @intFromFloat(std.math.clamp(channel, 0, 1) * 255);
+        }
+        fn draw(comptime rasterizer: Rasterizer, comptime multithreaded: bool, color_buffer: Buffer2D(RGBA), depth_buffer: Buffer2D(f32), thread_pool: *std.Thread.Pool) void {
+            const configuration = GraphicsPipelineConfiguration {
+                .do_depth_testing = true,
+                .use_triangle_2 = rasterizer == .rasterize_2,
+                .use_triangle_simd = rasterizer == .simd,
+                .use_triangle_fixed_point = rasterizer == .fixed_point,
+                .use_multithreading = multithreaded,
+                // not a multiple of the 8 pixel blocks of `use_triangle_simd`
+                .multithreading_tile_size = 12,
+            };
+            const Pipeline = GraphicsPipeline(RGBA, Context, Invariant, Vertex, configuration, vertex_shader, fragment_shader);
+            @memset(color_buffer.data, RGBA.make(0, 0, 0, 255));
+            @memset(depth_buffer.data, configuration.depth_clear_value());
+            const viewport_matrix = M44.viewport(0, 0, width, height, 1);
+            if (multithreaded) Pipeline.render(color_buffer, .{}, &vertices, vertices.len / 3, .{ .viewport_matrix = viewport_matrix, .depth_buffer = depth_buffer, .thread_pool = thread_pool, .allocator = std.testing.allocator })
+            else Pipeline.render(color_buffer, .{}, &vertices, vertices.len / 3, .{ .viewport_matrix = viewport_matrix, .depth_buffer = depth_buffer });
+        }
+    };
 
-            return interpolated_data;
+    var thread_pool: std.Thread.Pool = undefined;
+    try thread_pool.init(.{ .allocator = std.testing.allocator, .n_jobs = 4 });
+    defer thread_pool.deinit();
+    var serial_color: [width * height]RGBA = undefined;
+    var serial_depth: [width * height]f32 = undefined;
+    var parallel_color: [width * height]RGBA = undefined;
+    var parallel_depth: [width * height]f32 = undefined;
+    inline for (comptime std.enums.values(Rasterizer)) |rasterizer| {
+        scene.draw(rasterizer, false, Buffer2D(RGBA).from(&serial_color, width), Buffer2D(f32).from(&serial_depth, width), &thread_pool);
+        scene.draw(rasterizer, true, Buffer2D(RGBA).from(&parallel_color, width), Buffer2D(f32).from(&parallel_depth, width), &thread_pool);
+        try std.testing.expectEqualSlices(u8, std.mem.sliceAsBytes(&serial_color), std.mem.sliceAsBytes(&parallel_color));
+        try std.testing.expectEqualSlices(f32, &serial_depth, &parallel_depth);
+    }
+}
+
+test "use_visibility_buffer shades every covered pixel once and renders the same as shading immediately" {
+    const RGBA = pixels.RGBA;
+    const Context = struct { fragment_shader_calls: *usize };
+    const Invariant = struct { color: Vector3f };
+    const Vertex = struct { position: Vector3f, color: Vector3f };
+    const width = 32;
+    const height = 24;
+    // drawn back to front, so that shading right away shades the overlap twice
+    const vertices = [_]Vertex {
+        .{ .position = Vector3f.from(-0.9, -0.9, 0.8), .color = Vector3f.from(1, 0, 0) },
+        .{ .position = Vector3f.from(0.6, -0.7, 0.8), .color = Vector3f.from(0, 1, 0) },
+        .{ .position = Vector3f.from(-0.3, 0.8, 0.8), .color = Vector3f.from(0, 0, 1) },
+        .{ .position = Vector3f.from(-0.6, -0.5, 0.2), .color = Vector3f.from(1, 1, 0) },
+        .{ .position = Vector3f.from(0.9, -0.2, 0.2), .color = Vector3f.from(0, 1, 1) },
+        .{ .position = Vector3f.from(0.1, 0.9, 0.2), .color = Vector3f.from(1, 0, 1) },
+    };
+    const scene = struct {
+        fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector4f {
+            _ = context;
+            out_invariant.color = vertex.color;
+            return Vector4f.from(vertex.position.x, vertex.position.y, vertex.position.z, 1);
+        }
+        fn fragment_shader(context: Context, invariants: Invariant) RGBA {
+            context.fragment_shader_calls.* += 1;
+            return RGBA.make(to_byte(invariants.color.x), to_byte(invariants.color.y), to_byte(invariants.color.z), 255);
+        }
+        fn to_byte(channel: f32) u8 {
+            return @intFromFloat(std.math.clamp(channel, 0, 1) * 255);
+        }
+        /// returns how many times the fragment shader ran
+        fn draw(comptime deferred: bool, color_buffer: Buffer2D(RGBA), depth_buffer: Buffer2D(f32), visibility_buffer: Buffer2D(VisibilityBufferEntry)) usize {
+            const configuration = GraphicsPipelineConfiguration { .do_depth_testing = true, .use_visibility_buffer = deferred };
+            const Pipeline = GraphicsPipeline(RGBA, Context, Invariant, Vertex, configuration, vertex_shader, fragment_shader);
+            @memset(color_buffer.data, RGBA.make(0, 0, 0, 255));
+            @memset(depth_buffer.data, configuration.depth_clear_value());
+            var fragment_shader_calls: usize = 0;
+            const context = Context { .fragment_shader_calls = &fragment_shader_calls };
+            const viewport_matrix = M44.viewport(0, 0, width, height, 1);
+            if (deferred) Pipeline.render(color_buffer, context, &vertices, vertices.len / 3, .{ .viewport_matrix = viewport_matrix, .depth_buffer = depth_buffer, .visibility_buffer = visibility_buffer, .allocator = std.testing.allocator })
+            else Pipeline.render(color_buffer, context, &vertices, vertices.len / 3, .{ .viewport_matrix = viewport_matrix, .depth_buffer = depth_buffer });
+            return fragment_shader_calls;
         }
+    };
+
+    var immediate_color: [width * height]RGBA = undefined;
+    var deferred_color: [width * height]RGBA = undefined;
+    var depth: [width * height]f32 = undefined;
+    var visibility: [width * height]VisibilityBufferEntry = [_]VisibilityBufferEntry { VisibilityBufferEntry.empty } ** (width * height);
+    const visibility_buffer = Buffer2D(VisibilityBufferEntry).from(&visibility, width);
+    const immediate_calls = scene.draw(false, Buffer2D(RGBA).from(&immediate_color, width), Buffer2D(f32).from(&depth, width), visibility_buffer);
+    const deferred_calls = scene.draw(true, Buffer2D(RGBA).from(&deferred_color, width), Buffer2D(f32).from(&depth, width), visibility_buffer);
+
+    var covered_pixels: usize = 0;
+    for (depth) |pixel_depth| {
+        if (pixel_depth != 999999) covered_pixels += 1;
+    }
+    try std.testing.expect(covered_pixels > 0);
+    try std.testing.expectEqual(covered_pixels, deferred_calls);
+    try std.testing.expect(immediate_calls > covered_pixels);
+    try std.testing.expectEqualSlices(u8, std.mem.sliceAsBytes(&immediate_color), std.mem.sliceAsBytes(&deferred_color));
+    // and the visibility buffer is left cleared for the next draw
+    for (visibility) |entry| try std.testing.expectEqual(VisibilityBufferEntry.empty.triangle_id, entry.triangle_id);
+}
 
-        fn barycentric(triangle: [3]Vector3f, point: Vector3f) Vector3f {
-            // barycentric coordinates of the current pixel
-            const ab = triangle[1].substract(triangle[0]);
-            const ac = triangle[2].substract(triangle[0]);
-            const ap = point.substract(triangle[0]);
-            const bp = point.substract(triangle[1]);
-            const ca = triangle[0].substract(triangle[2]);
-
-            // TODO PERF we dont actually need many of the calculations of cross_product here, just the z
-            // the magnitude of the cross product can be interpreted as the area of the parallelogram.
-            const paralelogram_area_abc: f32 = ab.cross_product(ac).z;
-            const paralelogram_area_abp: f32 = ab.cross_product(bp).z;
-            const paralelogram_area_cap: f32 = ca.cross_product(ap).z;
-
-            const u: f32 = paralelogram_area_cap / paralelogram_area_abc;
-            const v: f32 = paralelogram_area_abp / paralelogram_area_abc;
-            const w: f32 = (1 - u - v);
-
-            return .{.x = u, .y = v, .z = w};
+test "rasterize_fixed_point covers the pixels along shared edges exactly once" {
+    const RGBA = pixels.RGBA;
+    const Context = struct {};
+    const Invariant = struct {};
+    const size = 16;
+    const scene = struct {
+        /// the positions are in screen space, with pixel centers at .5
+        fn vertex_shader(context: Context, position: Vector2f, out_invariant: *Invariant) Vector4f {
+            _ = context;
+            out_invariant.* = .{};
+            return Vector4f.from(position.x / (size / 2) - 1, position.y / (size / 2) - 1, 0.5, 1);
         }
+        /// every pixel drawn adds 1 to the red channel
+        fn fragment_shader(context: Context, invariants: Invariant) RGBA {
+            _ = context;
+            _ = invariants;
+            return RGBA.make(1, 0, 0, 255);
+        }
+        const Pipeline = GraphicsPipeline(RGBA, Context, Invariant, Vector2f, .{ .use_triangle_fixed_point = true, .blend_mode = .additive }, vertex_shader, fragment_shader);
+        fn draw(color_buffer: Buffer2D(RGBA), triangles: []const Vector2f) void {
+            @memset(color_buffer.data, RGBA.make(0, 0, 0, 255));
+            Pipeline.render(color_buffer, .{}, triangles, triangles.len / 3, .{ .viewport_matrix = M44.viewport(0, 0, size, size, 1) });
+        }
+    };
+    var data: [size * size]RGBA = undefined;
+    const color_buffer = Buffer2D(RGBA).from(&data, size);
+
+    // a square split along its diagonal, with every vertex on a pixel center, so the diagonal goes through pixel centers
+    const a = Vector2f { .x = 2.5, .y = 2.5 };
+    const b = Vector2f { .x = 13.5, .y = 2.5 };
+    const c = Vector2f { .x = 13.5, .y = 13.5 };
+    const d = Vector2f { .x = 2.5, .y = 13.5 };
+    scene.draw(color_buffer, &[_]Vector2f { a, b, c, a, c, d });
+    for (data) |pixel| try std.testing.expect(pixel.r <= 1);
+    for (3..13) |y| {
+        for (3..13) |x| try std.testing.expectEqual(@as(u8, 1), color_buffer.get(x, y).r);
+    }
 
-        fn trace_bb(left: usize, right: usize, top: usize, bottom: usize) void {
-            trace("T.BB: left {}, right {}, top {}, bottom {}", .{left, right, top, bottom});
+    // a fan around a vertex which is not on the pixel grid, nor on the subpixel grid
+    const center = Vector2f { .x = 8.3, .y = 7.6 };
+    const ring = [_]Vector2f { .{ .x = 1.2, .y = 1.7 }, .{ .x = 14.6, .y = 1.1 }, .{ .x = 15.1, .y = 9.25 }, .{ .x = 8.0, .y = 14.9 }, .{ .x = 0.7, .y = 12.3 } };
+    var fan: [ring.len * 3]Vector2f = undefined;
+    for (0..ring.len) |i| {
+        fan[i * 3 + 0] = center;
+        fan[i * 3 + 1] = ring[i];
+        fan[i * 3 + 2] = ring[(i + 1) % ring.len];
+    }
+    scene.draw(color_buffer, &fan);
+    var covered_pixels: usize = 0;
+    for (data) |pixel| {
+        try std.testing.expect(pixel.r <= 1);
+        covered_pixels += pixel.r;
+    }
+    try std.testing.expect(covered_pixels > 100);
+    // the pixels around the shared vertex
+    for (7..10) |y| {
+        for (7..10) |x| try std.testing.expectEqual(@as(u8, 1), color_buffer.get(x, y).r);
+    }
+}
+
+test "rasterize_simd renders the same as rasterize_1" {
+    const RGBA = pixels.RGBA;
+    const Context = struct {};
+    const Invariant = struct { color: Vector3f };
+    const Vertex = struct { position: Vector3f, color: Vector3f };
+    const size = 16;
+    // screen space positions on a half pixel grid and triangles with a power of 2 area, so that the barycentric coordinates are exact
+    // however they are calculated, and both rasterizers must agree on every bit of the coverage, the depth and the shading
+    const vertices = [_]Vertex {
+        .{ .position = Vector3f.from(0, 2, 0.25), .color = Vector3f.from(1, 0, 0) },
+        .{ .position = Vector3f.from(16, 2, 0.5), .color = Vector3f.from(0, 1, 0) },
+        .{ .position = Vector3f.from(6, 10, 0.75), .color = Vector3f.from(0, 0, 1) },
+        .{ .position = Vector3f.from(4, 0, 0.5), .color = Vector3f.from(1, 1, 0) },
+        .{ .position = Vector3f.from(12, 0, 0.25), .color = Vector3f.from(0, 1, 1) },
+        .{ .position = Vector3f.from(1, 16, 0.75), .color = Vector3f.from(1, 0, 1) },
+        .{ .position = Vector3f.from(2, 4, 0.125), .color = Vector3f.from(0.5, 0.25, 0) },
+        .{ .position = Vector3f.from(10, 4, 0.125), .color = Vector3f.from(0, 0.5, 0.25) },
+        .{ .position = Vector3f.from(2, 12, 0.125), .color = Vector3f.from(0.25, 0, 0.5) },
+    };
+    const scene = struct {
+        fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector4f {
+            _ = context;
+            out_invariant.color = vertex.color;
+            return Vector4f.from(vertex.position.x / (size / 2) - 1, vertex.position.y / (size / 2) - 1, vertex.position.z, 1);
+        }
+        fn fragment_shader(context: Context, invariants: Invariant) RGBA {
+            _ = context;
+            return RGBA.make(to_byte(invariants.color.x), to_byte(invariants.color.y), to_byte(invariants.color.z), 255);
+        }
+        fn to_byte(channel: f32) u8 {
+            return @intFromFloat(std.math.clamp(channel, 0, 1) * 255);
+        }
+        fn draw(comptime simd: bool, color_buffer: Buffer2D(RGBA), depth_buffer: Buffer2D(f32)) void {
+            const configuration = GraphicsPipelineConfiguration { .do_depth_testing = true, .use_triangle_simd = simd };
+            const Pipeline = GraphicsPipeline(RGBA, Context, Invariant, Vertex, configuration, vertex_shader, fragment_shader);
+            @memset(color_buffer.data, RGBA.make(0, 0, 0, 255));
+            @memset(depth_buffer.data, configuration.depth_clear_value());
+            Pipeline.render(color_buffer, .{}, &vertices, vertices.len / 3, .{ .viewport_matrix = M44.viewport(0, 0, size, size, 1), .depth_buffer = depth_buffer });
         }
+    };
+
+    var scalar_color: [size * size]RGBA = undefined;
+    var scalar_depth: [size * size]f32 = undefined;
+    var simd_color: [size * size]RGBA = undefined;
+    var simd_depth: [size * size]f32 = undefined;
+    scene.draw(false, Buffer2D(RGBA).from(&scalar_color, size), Buffer2D(f32).from(&scalar_depth, size));
+    scene.draw(true, Buffer2D(RGBA).from(&simd_color, size), Buffer2D(f32).from(&simd_depth, size));
+    try std.testing.expectEqualSlices(u8, std.mem.sliceAsBytes(&scalar_color), std.mem.sliceAsBytes(&simd_color));
+    try std.testing.expectEqualSlices(f32, &scalar_depth, &simd_depth);
+}
 
-        fn trace_triangle_4(t: [3]Vector4f) void {
-            trace("T.A: {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{t[0].x,t[0].y,t[0].z,t[0].w});
-            trace("T.B: {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{t[1].x,t[1].y,t[1].z,t[1].w});
-            trace("T.C: {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{t[2].x,t[2].y,t[2].z,t[2].w});
+test "texture_level_of_detail writes the uv per pixel of the triangle, also after clipping" {
+    const RGBA = pixels.RGBA;
+    // the smallest and biggest `uv_per_pixel` any fragment got
+    const Seen = struct { min: f32 = std.math.inf(f32), max: f32 = -std.math.inf(f32), fragments: usize = 0 };
+    const Context = struct { seen: *Seen };
+    const Invariant = struct { uv: Vector2f, uv_per_pixel: f32 };
+    const Vertex = struct { position: Vector3f, uv: Vector2f };
+    const size = 16;
+    const scene = struct {
+        fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector4f {
+            _ = context;
+            out_invariant.uv = vertex.uv;
+            out_invariant.uv_per_pixel = 0;
+            return Vector4f.from(vertex.position.x, vertex.position.y, vertex.position.z, 1);
+        }
+        fn fragment_shader(context: Context, invariants: Invariant) RGBA {
+            context.seen.min = @min(context.seen.min, invariants.uv_per_pixel);
+            context.seen.max = @max(context.seen.max, invariants.uv_per_pixel);
+            context.seen.fragments += 1;
+            return RGBA.make(255, 255, 255, 255);
         }
+        fn draw(vertices: []const Vertex) Seen {
+            const configuration = GraphicsPipelineConfiguration {
+                .do_triangle_clipping = true,
+                .texture_level_of_detail = .{ .uv_field = "uv", .uv_per_pixel_field = "uv_per_pixel" },
+            };
+            const Pipeline = GraphicsPipeline(RGBA, Context, Invariant, Vertex, configuration, vertex_shader, fragment_shader);
+            var color: [size * size]RGBA = undefined;
+            var seen = Seen {};
+            Pipeline.render(Buffer2D(RGBA).from(&color, size), .{ .seen = &seen }, vertices, vertices.len / 3, .{ .viewport_matrix = M44.viewport(0, 0, size, size, 1) });
+            return seen;
+        }
+    };
 
-        fn trace_triangle(t: [3]Vector3f) void {
-            trace("T.A: {d:.8}, {d:.8}, {d:.8}", .{t[0].x,t[0].y,t[0].z});
-            trace("T.B: {d:.8}, {d:.8}, {d:.8}", .{t[1].x,t[1].y,t[1].z});
-            trace("T.C: {d:.8}, {d:.8}, {d:.8}", .{t[2].x,t[2].y,t[2].z});
+    // covers half of the screen, 128 pixels, and half of a 0.5 by 0.25 rectangle of the texture, so every pixel covers
+    // sqrt((0.5 * 0.25 / 2) / 128) of the normalized texture along each axis
+    const expected: f32 = @sqrt((0.5 * 0.25 / 2.0) / 128.0);
+    const uvs = [3]Vector2f { Vector2f.from(0, 0), Vector2f.from(0.5, 0), Vector2f.from(0, 0.25) };
+    const whole = scene.draw(&[_]Vertex {
+        .{ .position = Vector3f.from(-1, -1, 0.5), .uv = uvs[0] },
+        .{ .position = Vector3f.from(1, -1, 0.5), .uv = uvs[1] },
+        .{ .position = Vector3f.from(-1, 1, 0.5), .uv = uvs[2] },
+    });
+    // the first vertex is behind the near plane, so the triangle is clipped into a quad. Without perspective the uvs are an affine function
+    // of the screen position, so both triangles of the quad still get the same uv per pixel
+    const clipped = scene.draw(&[_]Vertex {
+        .{ .position = Vector3f.from(-1, -1, -0.5), .uv = uvs[0] },
+        .{ .position = Vector3f.from(1, -1, 0.5), .uv = uvs[1] },
+        .{ .position = Vector3f.from(-1, 1, 0.5), .uv = uvs[2] },
+    });
+    try std.testing.expect(whole.fragments > clipped.fragments and clipped.fragments > 0);
+    for ([_]Seen { whole, clipped }) |seen| {
+        try std.testing.expectApproxEqRel(expected, seen.min, 1e-5);
+        try std.testing.expectApproxEqRel(expected, seen.max, 1e-5);
+    }
+}
+
+test "GraphicsPipelineQuads2D renders the same with and without blit" {
+    const RGBA = pixels.RGBA;
+    const Context = struct { texture: Buffer2D(RGBA) };
+    const Invariant = struct { texture_uv: Vector2f };
+    const Vertex = struct { pos: Vector2f, uv: Vector2f };
+    const size = 32;
+    const texture_width = 8;
+    const texture_height = 4;
+    const scene = struct {
+        /// a quad from `bl` to `tr` in screen space with the whole texture on it, mirrored horizontally if `mirrored`
+        fn quad(bl: Vector2f, tr: Vector2f, mirrored: bool) [4]Vertex {
+            const left_u: f32 = if (mirrored) texture_width else 0;
+            const right_u: f32 = if (mirrored) 0 else texture_width;
+            return .{
+                .{ .pos = bl, .uv = Vector2f.from(left_u, 0) },
+                .{ .pos = Vector2f.from(tr.x, bl.y), .uv = Vector2f.from(right_u, 0) },
+                .{ .pos = tr, .uv = Vector2f.from(right_u, texture_height) },
+                .{ .pos = Vector2f.from(bl.x, tr.y), .uv = Vector2f.from(left_u, texture_height) },
+            };
+        }
+        inline fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector3f {
+            _ = context;
+            out_invariant.texture_uv = vertex.uv;
+            return Vector3f.from(vertex.pos.x / (size / 2) - 1, vertex.pos.y / (size / 2) - 1, 1);
         }
+        inline fn fragment_shader(context: Context, invariants: Invariant) RGBA {
+            return context.texture.point_sample(false, invariants.texture_uv);
+        }
+        fn draw(comptime configuration: GraphicsPipelineQuads2DConfiguration, color_buffer: Buffer2D(RGBA), context: Context, vertices: []const Vertex) void {
+            const Pipeline = GraphicsPipelineQuads2D(RGBA, Context, Invariant, Vertex, configuration, vertex_shader, fragment_shader);
+            @memset(color_buffer.data, RGBA.make(0, 0, 0, 255));
+            Pipeline.render(color_buffer, context, vertices, vertices.len / 4, .{ .viewport_matrix = M33.viewport(0, 0, size, size) });
+        }
+    };
+
+    var texture_data: [texture_width * texture_height]RGBA = undefined;
+    for (&texture_data, 0..) |*texel, i| texel.* = RGBA.make(@intCast(i * 8), @intCast(255 - i * 8), @intCast(i % 3 * 100), 255);
+    const context = Context { .texture = Buffer2D(RGBA).from(&texture_data, texture_width) };
+    const vertices = comptime scene.quad(Vector2f.from(1, 1), Vector2f.from(9, 5), false) // 1 pixel per texel, copied row by row with `@memcpy`
+        ++ scene.quad(Vector2f.from(1, 6), Vector2f.from(25, 18), false) // 3 pixels per texel
+        ++ scene.quad(Vector2f.from(10, 1), Vector2f.from(26, 5), true) // mirrored, 2 pixels per texel
+        ++ scene.quad(Vector2f.from(3.3, 19), Vector2f.from(19.3, 23), false) // the left edge is not on a pixel boundary
+        ++ scene.quad(Vector2f.from(-6, 26), Vector2f.from(10, 34), false); // clipped by the left and the top of the screen
+
+    var expected: [size * size]RGBA = undefined;
+    scene.draw(.{ .do_quad_clipping = true }, Buffer2D(RGBA).from(&expected, size), context, &vertices);
+    const blit_configurations = [_]GraphicsPipelineQuads2DConfiguration {
+        .{ .do_quad_clipping = true, .blit = .{ .uv_field = "texture_uv" } },
+        .{ .do_quad_clipping = true, .blit = .{ .uv_field = "texture_uv", .texture_field = "texture" } },
+    };
+    inline for (blit_configurations) |configuration| {
+        var blitted: [size * size]RGBA = undefined;
+        scene.draw(configuration, Buffer2D(RGBA).from(&blitted, size), context, &vertices);
+        try std.testing.expectEqualSlices(u8, std.mem.sliceAsBytes(&expected), std.mem.sliceAsBytes(&blitted));
+    }
+}
 
-        fn trace_mat4(m: M44) void {
-            trace("M {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{m.data[0], m.data[4], m.data[8], m.data[12]});
-            trace("M {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{m.data[1], m.data[5], m.data[9], m.data[13]});
-            trace("M {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{m.data[2], m.data[6], m.data[10], m.data[14]});
-            trace("M {d:.8}, {d:.8}, {d:.8}, {d:.8}", .{m.data[3], m.data[7], m.data[11], m.data[15]});
+/// Records the draws of any number of `GraphicsPipeline`s, so that they can be sorted before being executed all at once on `flush`.
+/// Opaque draws are executed first and front to back, so the depth test rejects as many pixels as possible before shading them,
+/// and then translucent draws back to front, so that they blend correctly. Opaque draws are only sorted by a coarse depth bucket
+/// (about 1% of the distance to the camera), and grouped by pipeline inside of each bucket. Translucent draws with the exact same depth are grouped by pipeline.
+/// Whatever a recorded draw references (vertex buffers, index buffers, textures...) must stay alive until `flush`.
+pub fn DrawCommandList(comptime final_color_type: type) type {
+    return struct {
+
+        const Self = @This();
+
+        /// From the most significant bit, 1 bit for translucency and then
+        ///  - opaque: the top 16 bits of depth (sign, exponent and 7 bits of mantissa), 16 bits of pipeline id and 31 unused bits
+        ///  - translucent: 32 bits of depth, 16 bits of pipeline id and 15 unused bits
+        const Command = struct {
+            key: u64,
+            draw: *const anyopaque,
+            execute: *const fn (draw: *const anyopaque, pixel_buffer: Buffer2D(final_color_type)) void,
+        };
+
+        /// where a draw is in view space, to sort it
+        pub const Bounds = struct {
+            /// center of the bounding sphere of the draw, in view space (z grows away from the camera)
+            center: Vector3f,
+            radius: f32,
+            translucent: bool = false,
+        };
+
+        commands: std.ArrayList(Command),
+        sorted_commands: std.ArrayList(Command),
+        /// the copies of the contexts and requirements of the recorded draws
+        arena: std.heap.ArenaAllocator,
+
+        pub fn init(allocator: std.mem.Allocator) Self {
+            return .{
+                .commands = std.ArrayList(Command).init(allocator),
+                .sorted_commands = std.ArrayList(Command).init(allocator),
+                .arena = std.heap.ArenaAllocator.init(allocator),
+            };
         }
 
-        fn trace(comptime fmt: []const u8, args: anytype) void {
-            if (!pipeline_configuration.trace) return;
-            std.log.debug(fmt, args);
+        pub fn deinit(self: *Self) void {
+            self.commands.deinit();
+            self.sorted_commands.deinit();
+            self.arena.deinit();
+        }
+
+        /// Same arguments as `Pipeline.render`, which is called with them on `flush`
+        pub fn record(self: *Self, comptime Pipeline: type, context: anytype, vertex_buffer: anytype, face_count: usize, requirements: anytype, bounds: Bounds) void {
+            const Context = @TypeOf(context);
+            const VertexBuffer = @TypeOf(vertex_buffer);
+            const Requirements = @TypeOf(requirements);
+            const Draw = struct {
+                context: Context,
+                vertex_buffer: VertexBuffer,
+                face_count: usize,
+                requirements: Requirements,
+
+                fn execute(draw: *const anyopaque, pixel_buffer: Buffer2D(final_color_type)) void {
+                    const self_draw: *const @This() = @ptrCast(@alignCast(draw));
+                    Pipeline.render(pixel_buffer, self_draw.context, self_draw.vertex_buffer, self_draw.face_count, self_draw.requirements);
+                }
+            };
+            const draw = self.arena.allocator().create(Draw) catch @panic("OOM");
+            draw.* = .{ .context = context, .vertex_buffer = vertex_buffer, .face_count = face_count, .requirements = requirements };
+
+            // opaque draws sort by their nearest point and translucent ones by their center, reversed.
+            // The order of opaque draws only affects how many pixels get rejected early, so their depth is bucketed to let the pipeline id group them
+            const pipeline_id: u16 = comptime @truncate(std.hash.Fnv1a_32.hash(@typeName(Pipeline)));
+            const key = if (bounds.translucent)
+                (@as(u64, 1) << 63) | (@as(u64, ~sortable_depth(bounds.center.z)) << 31) | (@as(u64, pipeline_id) << 15)
+            else
+                (@as(u64, sortable_depth(bounds.center.z - bounds.radius) >> 16) << 47) | (@as(u64, pipeline_id) << 31);
+            self.commands.append(.{ .key = key, .draw = draw, .execute = Draw.execute }) catch @panic("OOM");
         }
 
+        /// sorts and executes every recorded draw, and empties the list
+        pub fn flush(self: *Self, pixel_buffer: Buffer2D(final_color_type)) void {
+            self.sorted_commands.resize(self.commands.items.len) catch @panic("OOM");
+            const sorted = radix_sort(self.commands.items, self.sorted_commands.items);
+            for (sorted) |command| command.execute(command.draw, pixel_buffer);
+            self.commands.clearRetainingCapacity();
+            _ = self.arena.reset(.retain_capacity);
+        }
+
+        /// The bits of an f32, flipped so that comparing them as unsigned integers orders them like the floats
+        fn sortable_depth(depth: f32) u32 {
+            const bits: u32 = @bitCast(depth);
+            return if (bits & 0x80000000 != 0) ~bits else bits | 0x80000000;
+        }
+
+        /// Least significant digit first radix sort, a byte at a time, of the keys of `commands`, ping-ponging with `scratch`.
+        /// Stable, so draws with the same key keep the order they were recorded in. Returns whichever of the two ends up sorted
+        fn radix_sort(commands: []Command, scratch: []Command) []Command {
+            var from = commands;
+            var to = scratch;
+            // the lowest 15 bits are unused
+            var shift: u6 = 8;
+            while (true) : (shift += 8) {
+                var counts = [_]usize {0} ** 256;
+                for (from) |command| counts[@as(u8, @truncate(command.key >> shift))] += 1;
+                // a pass where every key has the same byte would not change anything
+                if (std.mem.indexOfScalar(usize, &counts, from.len) == null) {
+                    var offset: usize = 0;
+                    for (&counts) |*count| {
+                        const bucket_size = count.*;
+                        count.* = offset;
+                        offset += bucket_size;
+                    }
+                    for (from) |command| {
+                        const bucket = &counts[@as(u8, @truncate(command.key >> shift))];
+                        to[bucket.*] = command;
+                        bucket.* += 1;
+                    }
+                    const swap = from;
+                    from = to;
+                    to = swap;
+                }
+                if (shift == 56) break;
+            }
+            return from;
+        }
     };
 }
 
 pub const GraphicsPipelineQuads2DConfiguration = struct {
+    /// same as `blend_mode = .alpha`
     blend_with_background: bool = false,
+    /// how the shaded pixels are written over the pixel buffer. Can't be used together with `blend_with_background`
+    blend_mode: ?BlendMode = null,
     do_quad_clipping: bool = false,
     do_scissoring: bool = false,
     trace: bool = false,
+    /// declares that the fragment shader point samples a texture, enabling the integer stepping fast path for quads whose texels
+    /// cover a whole number of pixels. See `QuadBlit`
+    blit: ?QuadBlit = null,
+    /// when the 4 vertices of a quad have the same invariants every pixel gets the same color, so the fragment shader runs once
+    /// per quad and the rows are filled with `pixels.fill_span`. Meant for solid color shapes
+    flat_quads: bool = false,
+
+    pub const QuadBlit = struct {
+        /// name of the `Vector2f` invariant with the texture coordinates, in texels (not normalized).
+        /// When u only changes horizontally, v only vertically, every other invariant is the same in all 4 vertices and
+        /// each texel is exactly 1, 2, 3... pixels wide, the texels are stepped through with integers rather than interpolating
+        /// every invariant for every pixel, and the fragment shader gets the center of the texel
+        uv_field: []const u8,
+        /// name of a `Buffer2D(final_color_type)` of the context which the fragment shader returns the point samples of, unchanged.
+        /// When set and the quads are opaque, the fragment shader is skipped altogether and the texels are copied into the
+        /// pixel buffer, whole rows at once with `@memcpy` when they are not scaled nor mirrored
+        texture_field: ?[]const u8 = null,
+    };
     
+    /// `blend_mode` if set, otherwise `alpha` or `opaque` depending on `blend_with_background`
+    pub fn effective_blend_mode(comptime self: GraphicsPipelineQuads2DConfiguration) BlendMode {
+        if (self.blend_mode) |mode| {
+            if (self.blend_with_background) @compileError("Only one option can be active: `blend_mode`, or `blend_with_background`");
+            return mode;
+        }
+        return if (self.blend_with_background) .alpha else .@"opaque";
+    }
+
     /// returns a comptime tpye (an struct, basically) which needs to be filled, and passed as a value to the render pipeline when calling `render`
     pub fn Requirements(comptime self: GraphicsPipelineQuads2DConfiguration) type {
         var fields: []const std.builtin.Type.StructField = &[_]std.builtin.Type.StructField {
@@ -953,27 +2257,154 @@ pub fn GraphicsPipelineQuads2D(
             if (bb.top == 0) return;
             if (bb.right == 0) return;
 
+            if (pipeline_configuration.blit != null) {
+                if (blit_rasterizer(pixel_buffer, context, quad, invariants, bb)) return;
+            }
+            if (pipeline_configuration.flat_quads) {
+                if (flat_rasterizer(pixel_buffer, context, invariants, bb)) return;
+            }
+
             var y = bb.bottom;
             while (y < bb.top) : (y += 1) {
                 const percentage_y: f32 = (@as(f32, @floatFromInt(y))-quad[0].y+0.5) / height_f;
                 std.debug.assert(percentage_y <= 1 and percentage_y >= 0);
 
+                // the row is shaded in spans, which are then blended into the pixel buffer all at once
+                const span_size = 64;
+                var span: [span_size]final_color_type = undefined;
                 var x = bb.left;
-                while (x < bb.right) : (x += 1) {
-                    const percentage_x: f32 = (@as(f32, @floatFromInt(x))-quad[0].x+0.5) / width_f;
-                    std.debug.assert(percentage_x <= 1 and percentage_x >= 0);
+                while (x < bb.right) {
+                    const span_end = @min(x + span_size, bb.right);
+                    for (x..span_end, span[0..span_end - x]) |pixel_x, *final_color| {
+                        const percentage_x: f32 = (@as(f32, @floatFromInt(pixel_x))-quad[0].x+0.5) / width_f;
+                        std.debug.assert(percentage_x <= 1 and percentage_x >= 0);
+
+                        const interpolated_invariants: invariant_type = interpolate(invariant_type, invariants, percentage_x, percentage_y);
+                        final_color.* = fragment_shader(context, interpolated_invariants);
+                    }
+                    const row = pixel_buffer.data[x + pixel_buffer.width * y .. span_end + pixel_buffer.width * y];
+                    pixels.blend_span(final_color_type, comptime pipeline_configuration.effective_blend_mode(), span[0..span_end - x], row);
+                    x = span_end;
+                }
+            }
+        }
+
+        /// The fast path for `blit` quads. Returns false without drawing anything if the quad can't take it
+        fn blit_rasterizer(pixel_buffer: Buffer2D(final_color_type), context: context_type, quad: [4]Vector2f, invariants: [4]invariant_type, bb: BoundingBox) bool {
+            const blit = comptime pipeline_configuration.blit.?;
+            const uv = [4]Vector2f { @field(invariants[0], blit.uv_field), @field(invariants[1], blit.uv_field), @field(invariants[2], blit.uv_field), @field(invariants[3], blit.uv_field) };
+            // clipped quads get their uvs interpolated, so allow for some rounding
+            const tolerance = 0.001;
+            if (@abs(uv[0].x - uv[3].x) > tolerance or @abs(uv[1].x - uv[2].x) > tolerance or @abs(uv[0].y - uv[1].y) > tolerance or @abs(uv[3].y - uv[2].y) > tolerance) return false;
+            inline for (@typeInfo(invariant_type).Struct.fields) |field| {
+                if (comptime std.mem.eql(u8, field.name, blit.uv_field)) continue;
+                for (invariants[1..]) |other| {
+                    if (!std.meta.eql(@field(other, field.name), @field(invariants[0], field.name))) return false;
+                }
+            }
+
+            const height_f: f32 = quad[2].y - quad[0].y;
+            const width_f: f32 = quad[1].x - quad[3].x;
+            const texels_wide = uv[1].x - uv[0].x;
+            if (texels_wide == 0) return false;
+            const pixels_per_texel_f = @abs(width_f / texels_wide);
+            const pixels_per_texel = @round(pixels_per_texel_f);
+            if (pixels_per_texel < 1 or @abs(pixels_per_texel_f - pixels_per_texel) > tolerance) return false;
+            if (bb.right <= bb.left or bb.top <= bb.bottom) return true;
+
+            // start from the same texel the general path would sample for the first pixel, and from how many pixels into that texel it is
+            const forward = texels_wide > 0;
+            const first_u = uv[0].x + texels_wide * ((@as(f32, @floatFromInt(bb.left)) - quad[0].x + 0.5) / width_f);
+            const first_texel_f = @floor(first_u);
+            const into_texel = if (forward) first_u - first_texel_f else first_texel_f + 1 - first_u;
+            const first_stepper = TexelStepper {
+                .texel = @intFromFloat(first_texel_f),
+                .step = if (forward) 1 else -1,
+                .phase = @min(@as(usize, @intFromFloat(into_texel * pixels_per_texel)), @as(usize, @intFromFloat(pixels_per_texel)) - 1),
+                .pixels_per_texel = @intFromFloat(pixels_per_texel),
+            };
+
+            var interpolated_invariants = invariants[0];
+            var y = bb.bottom;
+            while (y < bb.top) : (y += 1) {
+                const percentage_y: f32 = (@as(f32, @floatFromInt(y))-quad[0].y+0.5) / height_f;
+                const v = uv[0].y + (uv[3].y - uv[0].y) * percentage_y;
+                const row = pixel_buffer.data[bb.left + pixel_buffer.width * y .. bb.right + pixel_buffer.width * y];
 
-                    const interpolated_invariants: invariant_type = interpolate(invariant_type, invariants, percentage_x, percentage_y);
-                    const final_color = fragment_shader(context, interpolated_invariants);
+                if (comptime blit.texture_field != null and pipeline_configuration.effective_blend_mode() == .@"opaque") {
+                    const texture: Buffer2D(final_color_type) = @field(context, blit.texture_field.?);
+                    if (copy_texels(texture, row, v, first_stepper)) continue;
+                }
 
-                    if (pipeline_configuration.blend_with_background) {
-                        const old_color = pixel_buffer.get(x, y);
-                        pixel_buffer.set(x, y, final_color.blend(old_color));
+                @field(interpolated_invariants, blit.uv_field).y = v;
+                var stepper = first_stepper;
+                const span_size = 64;
+                var span: [span_size]final_color_type = undefined;
+                var x: usize = 0;
+                while (x < row.len) {
+                    const span_end = @min(x + span_size, row.len);
+                    for (span[0..span_end - x]) |*final_color| {
+                        @field(interpolated_invariants, blit.uv_field).x = @as(f32, @floatFromInt(stepper.texel)) + 0.5;
+                        final_color.* = fragment_shader(context, interpolated_invariants);
+                        stepper.advance();
                     }
-                    else pixel_buffer.set(x, y, final_color);
+                    pixels.blend_span(final_color_type, comptime pipeline_configuration.effective_blend_mode(), span[0..span_end - x], row[x..span_end]);
+                    x = span_end;
+                }
+            }
+            return true;
+        }
 
+        /// The fast path for `flat_quads`. Returns false without drawing anything if the invariants are not the same in all 4 vertices
+        fn flat_rasterizer(pixel_buffer: Buffer2D(final_color_type), context: context_type, invariants: [4]invariant_type, bb: BoundingBox) bool {
+            for (invariants[1..]) |other| {
+                if (!std.meta.eql(other, invariants[0])) return false;
+            }
+            if (bb.right <= bb.left) return true;
+            const final_color = fragment_shader(context, invariants[0]);
+            var y = bb.bottom;
+            while (y < bb.top) : (y += 1) {
+                const row = pixel_buffer.data[bb.left + pixel_buffer.width * y .. bb.right + pixel_buffer.width * y];
+                pixels.fill_span(final_color_type, comptime pipeline_configuration.effective_blend_mode(), final_color, row);
+            }
+            return true;
+        }
+
+        /// Walks the texels of a row of a `blit` quad, `pixels_per_texel` pixels per texel
+        const TexelStepper = struct {
+            texel: isize,
+            step: isize,
+            phase: usize,
+            pixels_per_texel: usize,
+
+            inline fn advance(self: *TexelStepper) void {
+                self.phase += 1;
+                if (self.phase == self.pixels_per_texel) {
+                    self.phase = 0;
+                    self.texel += self.step;
                 }
             }
+        };
+
+        /// Copies the texels of row `v` of the texture straight into `row`. Returns false if any of them would be out of the texture,
+        /// since the general path clamps those
+        fn copy_texels(texture: Buffer2D(final_color_type), row: []final_color_type, v: f32, first_stepper: TexelStepper) bool {
+            if (v < 0 or v >= @as(f32, @floatFromInt(texture.height))) return false;
+            const last_texel = first_stepper.texel + first_stepper.step * @as(isize, @intCast((first_stepper.phase + row.len - 1) / first_stepper.pixels_per_texel));
+            if (@min(first_stepper.texel, last_texel) < 0 or @max(first_stepper.texel, last_texel) >= @as(isize, @intCast(texture.width))) return false;
+            const texel_y: usize = @intFromFloat(v);
+            const texture_row = texture.data[texture.width * texel_y .. texture.width * (texel_y + 1)];
+            if (first_stepper.pixels_per_texel == 1 and first_stepper.step == 1) {
+                const start: usize = @intCast(first_stepper.texel);
+                @memcpy(row, texture_row[start .. start + row.len]);
+                return true;
+            }
+            var stepper = first_stepper;
+            for (row) |*pixel| {
+                pixel.* = texture_row[@intCast(stepper.texel)];
+                stepper.advance();
+            }
+            return true;
         }
 
         const BoundingBox = struct {
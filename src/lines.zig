@@ -0,0 +1,319 @@
+const std = @import("std");
+const math = @import("math.zig");
+const Buffer2D = @import("buffer.zig").Buffer2D;
+const graphics = @import("graphics.zig");
+const DepthFormat = graphics.DepthFormat;
+
+const Vector2f = math.Vector2f;
+const Vector3f = math.Vector3f;
+const Vector4f = math.Vector4f;
+const M44 = math.M44;
+
+/// An area of a buffer in pixels, `right` and `top` are exclusive
+pub const ClipRect = struct {
+    left: i32,
+    bottom: i32,
+    right: i32,
+    top: i32,
+
+    pub fn from_buffer(width: usize, height: usize) ClipRect {
+        return .{ .left = 0, .bottom = 0, .right = @intCast(width), .top = @intCast(height) };
+    }
+};
+
+/// Draws batches of line segments with integer Bresenham stepping, clipping them (Cohen-Sutherland) against the buffer or a scissor rect first,
+/// so that nothing is ever written out of bounds. Colors are given per vertex and interpolated along the line in 16.16 fixed point.
+/// `T` must be a pixel type made only of `u8` channels.
+/// Unlike `Buffer2D.line`, the segments are in screen space floats (y up, pixel centers at .5) like the vertices of the pipelines.
+/// `depth_format` and `reversed_z` must match the ones of the `GraphicsPipeline` whose depth buffer the 3D lines share.
+pub fn LineRenderer(comptime T: type, comptime depth_format: DepthFormat, comptime reversed_z: bool) type {
+    return struct {
+
+        const Depth = depth_format.Type();
+
+        pub const Vertex = struct {
+            position: Vector2f,
+            color: T,
+        };
+
+        pub const Vertex3D = struct {
+            position: Vector3f,
+            color: T,
+        };
+
+        const channels = @typeInfo(T).Struct.fields;
+        const Channels = @Vector(channels.len, i32);
+
+        /// every 2 vertices are a segment
+        pub fn draw_lines(pixel_buffer: Buffer2D(T), scissor_rect: ?ClipRect, vertices: []const Vertex) void {
+            std.debug.assert(vertices.len % 2 == 0);
+            const rect = scissor_rect orelse ClipRect.from_buffer(pixel_buffer.width, pixel_buffer.height);
+            var i: usize = 0;
+            while (i < vertices.len) : (i += 2) {
+                draw_clipped_segment(pixel_buffer, null, rect, vertices[i].position, vertices[i + 1].position, vertices[i].color, vertices[i + 1].color, 0, 0);
+            }
+        }
+
+        /// Every 2 vertices are a segment in model space, transformed by `model_view_projection_matrix` and then `viewport_matrix`
+        /// just like the triangle pipeline would. The segments are clipped against the near plane, and every pixel is tested against
+        /// (and written to) `depth_buffer` using the same convention as `do_depth_testing`
+        pub fn draw_lines_3d(pixel_buffer: Buffer2D(T), depth_buffer: Buffer2D(Depth), scissor_rect: ?ClipRect, model_view_projection_matrix: M44, viewport_matrix: M44, vertices: []const Vertex3D) void {
+            std.debug.assert(vertices.len % 2 == 0);
+            const rect = scissor_rect orelse ClipRect.from_buffer(pixel_buffer.width, pixel_buffer.height);
+            var i: usize = 0;
+            while (i < vertices.len) : (i += 2) {
+                var a = model_view_projection_matrix.apply_to_vec3(vertices[i].position);
+                var b = model_view_projection_matrix.apply_to_vec3(vertices[i + 1].position);
+                var color_a = vertices[i].color;
+                var color_b = vertices[i + 1].color;
+                const distance_a = near_plane_distance(a);
+                const distance_b = near_plane_distance(b);
+                if (distance_a < 0 and distance_b < 0) continue;
+                if (distance_a < 0 or distance_b < 0) {
+                    const t = distance_a / (distance_a - distance_b);
+                    const clipped = Vector4f {
+                        .x = a.x + (b.x - a.x) * t,
+                        .y = a.y + (b.y - a.y) * t,
+                        .z = a.z + (b.z - a.z) * t,
+                        .w = a.w + (b.w - a.w) * t,
+                    };
+                    const clipped_color = lerp_color(color_a, color_b, t);
+                    if (distance_a < 0) {
+                        a = clipped;
+                        color_a = clipped_color;
+                    }
+                    else {
+                        b = clipped;
+                        color_b = clipped_color;
+                    }
+                }
+                const ndc_a = a.perspective_division();
+                const ndc_b = b.perspective_division();
+                const screen_a = viewport_matrix.apply_to_vec3(ndc_a).perspective_division();
+                const screen_b = viewport_matrix.apply_to_vec3(ndc_b).perspective_division();
+                draw_clipped_segment(pixel_buffer, depth_buffer, rect, Vector2f { .x = screen_a.x, .y = screen_a.y }, Vector2f { .x = screen_b.x, .y = screen_b.y }, color_a, color_b, ndc_a.z, ndc_b.z);
+            }
+        }
+
+        /// positive on the visible side of the near plane, which is z = 0 in clip space, or z = w with `reversed_z`
+        inline fn near_plane_distance(p: Vector4f) f32 {
+            return if (reversed_z) p.w - p.z else p.z;
+        }
+
+        const Outcode = packed struct(u4) {
+            left: bool = false,
+            right: bool = false,
+            bottom: bool = false,
+            top: bool = false,
+
+            fn of(p: Vector2f, min: Vector2f, max: Vector2f) Outcode {
+                return .{ .left = p.x < min.x, .right = p.x > max.x, .bottom = p.y < min.y, .top = p.y > max.y };
+            }
+
+            fn inside(self: Outcode) bool {
+                return @as(u4, @bitCast(self)) == 0;
+            }
+
+            fn shares_a_side(self: Outcode, other: Outcode) bool {
+                return @as(u4, @bitCast(self)) & @as(u4, @bitCast(other)) != 0;
+            }
+        };
+
+        /// Cohen-Sutherland against `rect`, keeping track of how far along the original segment each endpoint moved so that the
+        /// colors and depths can be moved along with them
+        fn draw_clipped_segment(pixel_buffer: Buffer2D(T), depth_buffer: ?Buffer2D(Depth), rect: ClipRect, a: Vector2f, b: Vector2f, color_a: T, color_b: T, depth_a: f32, depth_b: f32) void {
+            if (rect.right <= rect.left or rect.top <= rect.bottom) return;
+            const min = Vector2f { .x = @floatFromInt(rect.left), .y = @floatFromInt(rect.bottom) };
+            // the last pixel center that is still inside is at `right - 0.5`, so anything up to `right` rounds down into the rect
+            const max = Vector2f { .x = @as(f32, @floatFromInt(rect.right)) - 0.001, .y = @as(f32, @floatFromInt(rect.top)) - 0.001 };
+            var t0: f32 = 0;
+            var t1: f32 = 1;
+            var p0 = a;
+            var p1 = b;
+            var code0 = Outcode.of(p0, min, max);
+            var code1 = Outcode.of(p1, min, max);
+            var iterations: usize = 0;
+            while (!(code0.inside() and code1.inside())) : (iterations += 1) {
+                if (code0.shares_a_side(code1)) return;
+                // every endpoint moves onto at most 2 sides, so anything still outside after that is rounding error
+                if (iterations == 4) {
+                    p0 = Vector2f { .x = std.math.clamp(p0.x, min.x, max.x), .y = std.math.clamp(p0.y, min.y, max.y) };
+                    p1 = Vector2f { .x = std.math.clamp(p1.x, min.x, max.x), .y = std.math.clamp(p1.y, min.y, max.y) };
+                    break;
+                }
+                // move whichever endpoint is outside onto the side it is outside of
+                const move_first = !code0.inside();
+                const code = if (move_first) code0 else code1;
+                const t: f32 = if (code.left) (min.x - a.x) / (b.x - a.x)
+                    else if (code.right) (max.x - a.x) / (b.x - a.x)
+                    else if (code.bottom) (min.y - a.y) / (b.y - a.y)
+                    else (max.y - a.y) / (b.y - a.y);
+                var p = Vector2f { .x = a.x + (b.x - a.x) * t, .y = a.y + (b.y - a.y) * t };
+                // snap to the side exactly, so that rounding errors don't leave it outside forever
+                if (code.left) p.x = min.x else if (code.right) p.x = max.x else if (code.bottom) p.y = min.y else p.y = max.y;
+                if (move_first) {
+                    p0 = p;
+                    t0 = t;
+                    code0 = Outcode.of(p0, min, max);
+                }
+                else {
+                    p1 = p;
+                    t1 = t;
+                    code1 = Outcode.of(p1, min, max);
+                }
+            }
+            const clipped_color_a = if (t0 == 0) color_a else lerp_color(color_a, color_b, t0);
+            const clipped_color_b = if (t1 == 1) color_b else lerp_color(color_a, color_b, t1);
+            draw_segment(
+                pixel_buffer, depth_buffer,
+                @intFromFloat(@floor(p0.x)), @intFromFloat(@floor(p0.y)), @intFromFloat(@floor(p1.x)), @intFromFloat(@floor(p1.y)),
+                clipped_color_a, clipped_color_b,
+                depth_a + (depth_b - depth_a) * t0, depth_a + (depth_b - depth_a) * t1,
+            );
+        }
+
+        /// Bresenham between 2 pixels which are already known to be inside of the buffer, both included
+        fn draw_segment(pixel_buffer: Buffer2D(T), depth_buffer: ?Buffer2D(Depth), x0: i32, y0: i32, x1: i32, y1: i32, color_a: T, color_b: T, depth_a: f32, depth_b: f32) void {
+            const dx: i32 = @intCast(@abs(x1 - x0));
+            const dy: i32 = -@as(i32, @intCast(@abs(y1 - y0)));
+            const sx: i32 = if (x0 < x1) 1 else -1;
+            const sy: i32 = if (y0 < y1) 1 else -1;
+            const steps = @max(dx, -dy);
+
+            const solid = std.meta.eql(color_a, color_b);
+            var color: Channels = to_channels(color_a) << @splat(16);
+            const color_step: Channels = if (steps == 0 or solid) @splat(0) else @divTrunc((to_channels(color_b) - to_channels(color_a)) << @splat(16), @as(Channels, @splat(steps)));
+            var depth = depth_a;
+            const depth_step = if (steps == 0) 0 else (depth_b - depth_a) / @as(f32, @floatFromInt(steps));
+
+            var x = x0;
+            var y = y0;
+            var err = dx + dy;
+            while (true) {
+                const px: usize = @intCast(x);
+                const py: usize = @intCast(y);
+                const encoded_depth = depth_format.encode(depth);
+                const passes_depth_test = if (depth_buffer) |db| graphics.depth_test_passes(reversed_z, db.get(px, py), encoded_depth) else true;
+                if (passes_depth_test) {
+                    if (depth_buffer) |db| db.set(px, py, encoded_depth);
+                    pixel_buffer.set(px, py, if (solid) color_a else from_channels(color >> @splat(16)));
+                }
+                if (x == x1 and y == y1) break;
+                const e2 = 2 * err;
+                if (e2 >= dy) {
+                    err += dy;
+                    x += sx;
+                }
+                if (e2 <= dx) {
+                    err += dx;
+                    y += sy;
+                }
+                color += color_step;
+                depth += depth_step;
+            }
+        }
+
+        inline fn to_channels(color: T) Channels {
+            var result: [channels.len]i32 = undefined;
+            inline for (channels, 0..) |channel, i| result[i] = @field(color, channel.name);
+            return result;
+        }
+
+        inline fn from_channels(values: Channels) T {
+            const values_array: [channels.len]i32 = values;
+            var result: T = undefined;
+            inline for (channels, 0..) |channel, i| @field(result, channel.name) = @intCast(std.math.clamp(values_array[i], 0, 255));
+            return result;
+        }
+
+        fn lerp_color(a: T, b: T, t: f32) T {
+            const weight: i32 = @intFromFloat(std.math.clamp(t, 0, 1) * 256);
+            return from_channels(to_channels(a) + @divTrunc((to_channels(b) - to_channels(a)) * @as(Channels, @splat(weight)), @as(Channels, @splat(256))));
+        }
+    };
+}
+
+test "LineRenderer clips segments to the buffer and steps every pixel" {
+    const RGBA = @import("pixels.zig").RGBA;
+    const Lines = LineRenderer(RGBA, .float32, false);
+    var data = [_]RGBA { RGBA.make(0, 0, 0, 0) } ** (16 * 8);
+    const pixel_buffer = Buffer2D(RGBA).from(&data, 16);
+    const white = RGBA.make(255, 255, 255, 255);
+
+    // a horizontal line way past both sides of the buffer only touches the row it is on
+    Lines.draw_lines(pixel_buffer, null, &[_]Lines.Vertex {
+        .{ .position = .{ .x = -100, .y = 2.5 }, .color = white },
+        .{ .position = .{ .x = 100, .y = 2.5 }, .color = white },
+    });
+    var count: usize = 0;
+    for (data) |pixel| {
+        if (pixel.r == 255) count += 1;
+    }
+    try std.testing.expectEqual(@as(usize, 16), count);
+    for (0..16) |x| try std.testing.expectEqual(white, pixel_buffer.get(x, 2));
+
+    // a diagonal inside of a scissor rect
+    @memset(&data, RGBA.make(0, 0, 0, 0));
+    Lines.draw_lines(pixel_buffer, .{ .left = 2, .bottom = 2, .right = 6, .top = 6 }, &[_]Lines.Vertex {
+        .{ .position = .{ .x = 0.5, .y = 0.5 }, .color = white },
+        .{ .position = .{ .x = 7.5, .y = 7.5 }, .color = white },
+    });
+    for (0..8) |i| try std.testing.expectEqual(i >= 2 and i < 6, pixel_buffer.get(i, i).r == 255);
+    // endpoints fully outside on the same side
+    @memset(&data, RGBA.make(0, 0, 0, 0));
+    Lines.draw_lines(pixel_buffer, null, &[_]Lines.Vertex {
+        .{ .position = .{ .x = -5, .y = 1 }, .color = white },
+        .{ .position = .{ .x = -1, .y = 6 }, .color = white },
+    });
+    for (data) |pixel| try std.testing.expectEqual(@as(u8, 0), pixel.r);
+}
+
+test "LineRenderer draws 3d lines with the depth convention of the pipeline" {
+    const RGBA = @import("pixels.zig").RGBA;
+    const red = RGBA.make(255, 0, 0, 255);
+    const green = RGBA.make(0, 255, 0, 255);
+    const blue = RGBA.make(0, 0, 255, 255);
+    var data: [16 * 8]RGBA = undefined;
+    const pixel_buffer = Buffer2D(RGBA).from(&data, 16);
+    const viewport_matrix = M44.viewport(0, 0, 16, 8, 1);
+    // ndc y of the center of the row 2
+    const y = -0.375;
+
+    inline for (.{ .{ DepthFormat.float32, false }, .{ DepthFormat.unorm16, true } }) |convention| {
+        const depth_format = convention[0];
+        const reversed_z = convention[1];
+        const Lines = LineRenderer(RGBA, depth_format, reversed_z);
+        const configuration = graphics.GraphicsPipelineConfiguration { .depth_format = depth_format, .reversed_z = reversed_z };
+        // depths from the nearest to the farthest
+        const near: f32 = if (reversed_z) 0.7 else 0.3;
+        const middle: f32 = 0.5;
+        const far: f32 = if (reversed_z) 0.3 else 0.7;
+        var depth_data: [16 * 8]depth_format.Type() = undefined;
+        const depth_buffer = Buffer2D(depth_format.Type()).from(&depth_data, 16);
+        @memset(&data, RGBA.make(0, 0, 0, 0));
+        @memset(&depth_data, configuration.depth_clear_value());
+
+        // a closer line overwrites a farther one, but not the other way around
+        Lines.draw_lines_3d(pixel_buffer, depth_buffer, null, M44.identity(), viewport_matrix, &[_]Lines.Vertex3D {
+            .{ .position = Vector3f.from(-1, y, middle), .color = red },
+            .{ .position = Vector3f.from(1, y, middle), .color = red },
+            .{ .position = Vector3f.from(-1, y, near), .color = green },
+            .{ .position = Vector3f.from(1, y, near), .color = green },
+            .{ .position = Vector3f.from(-1, y, far), .color = blue },
+            .{ .position = Vector3f.from(1, y, far), .color = blue },
+        });
+        for (0..16) |x| try std.testing.expectEqual(green, pixel_buffer.get(x, 2));
+        try std.testing.expectEqual(depth_format.encode(near), depth_buffer.get(4, 2));
+
+        // a line crossing the near plane halfway through only draws its visible half
+        @memset(&data, RGBA.make(0, 0, 0, 0));
+        @memset(&depth_data, configuration.depth_clear_value());
+        const behind_the_camera: f32 = if (reversed_z) 1.5 else -0.5;
+        const y_row_5 = 0.375;
+        Lines.draw_lines_3d(pixel_buffer, depth_buffer, null, M44.identity(), viewport_matrix, &[_]Lines.Vertex3D {
+            .{ .position = Vector3f.from(-1, y_row_5, middle), .color = red },
+            .{ .position = Vector3f.from(1, y_row_5, behind_the_camera), .color = red },
+        });
+        for (0..16) |x| try std.testing.expectEqual(x <= 8, pixel_buffer.get(x, 5).r == 255);
+    }
+}
@@ -4,6 +4,10 @@ pub const Vector2f = Vec2(f32);
 pub const Vector2i = Vec2(i32);
 pub const Vector3f = Vec3(f32);
 pub const Vector4f = Vec4(f32);
+/// 8 `Vector3f` at once, one per lane, for batched (structure of arrays) processing
+pub const Vector3fx8 = Vec3(@Vector(8, f32));
+/// 8 `Vector4f` at once, one per lane, for batched (structure of arrays) processing
+pub const Vector4fx8 = Vec4(@Vector(8, f32));
 
 pub fn Vec2(comptime T: type) type {
     return struct {
@@ -422,6 +426,35 @@ pub const M44 = struct {
         return point_transformed;
     }
     
+    /// same as `apply_to_vec3` but for 8 points at once
+    pub fn apply_to_vec3_x8(self: M44, point: Vector3fx8) Vector4fx8 {
+        const m = self.lanes_x8();
+        return .{
+            .x = m[0] * point.x + m[4] * point.y + m[8] * point.z + m[12],
+            .y = m[1] * point.x + m[5] * point.y + m[9] * point.z + m[13],
+            .z = m[2] * point.x + m[6] * point.y + m[10] * point.z + m[14],
+            .w = m[3] * point.x + m[7] * point.y + m[11] * point.z + m[15],
+        };
+    }
+
+    /// same as `apply_to_vec4` but for 8 points at once
+    pub fn apply_to_vec4_x8(self: M44, point4d: Vector4fx8) Vector4fx8 {
+        const m = self.lanes_x8();
+        return .{
+            .x = m[0] * point4d.x + m[4] * point4d.y + m[8] * point4d.z + m[12] * point4d.w,
+            .y = m[1] * point4d.x + m[5] * point4d.y + m[9] * point4d.z + m[13] * point4d.w,
+            .z = m[2] * point4d.x + m[6] * point4d.y + m[10] * point4d.z + m[14] * point4d.w,
+            .w = m[3] * point4d.x + m[7] * point4d.y + m[11] * point4d.z + m[15] * point4d.w,
+        };
+    }
+
+    /// every element of the matrix broadcast to the 8 lanes of a vector
+    inline fn lanes_x8(self: M44) [16]@Vector(8, f32) {
+        var m: [16]@Vector(8, f32) = undefined;
+        inline for (0..16) |i| m[i] = @splat(self.data[i]);
+        return m;
+    }
+
     pub fn apply_to_point(self: M44, point: Vector3f) Vector3f {
         // Embed the `point` into "4D" by augmenting it with 1, so that we can work with it.
         // 
@@ -685,6 +718,14 @@ pub const M44 = struct {
         return matrix;
     }
     
+    /// same as `perspective_projection`, but the depth goes from 1 at the `near` plane to 0 at the `far` plane, for pipelines with `reversed_z`
+    pub fn perspective_projection_reversed_z(fov_degrees: f32, aspect_ratio: f32, n: f32, f: f32) M44 {
+        var matrix = perspective_projection_unrolled(fov_degrees, aspect_ratio, n, f);
+        matrix.data[10] = -n/(f-n);
+        matrix.data[14] = (f*n)/(f-n);
+        return matrix;
+    }
+
     /// Builds a "viewport" (as its called in opengl) matrix, a matrix that
     /// will map a point in the 3-dimensional cube [-1, 1]*[-1, 1]*[-1, 1]
     /// onto the screen cube [x, x+w]*[y, y+h]*[0, d],
@@ -768,6 +809,58 @@ pub const Frustum = struct {
     bottom: Plane,
     near: Plane,
     far: Plane,
+
+    pub const Containment = enum {
+        outside,
+        intersecting,
+        inside,
+    };
+
+    /// the planes point inwards, so a sphere is outside if it is completely in the negative halfspace of any of them
+    pub fn classify_sphere(self: Frustum, center: Vector3f, radius: f32) Containment {
+        var result = Containment.inside;
+        inline for (@typeInfo(Frustum).Struct.fields) |field| {
+            const distance = @field(self, field.name).signed_distance_to_point(center);
+            if (distance < -radius) return .outside;
+            if (distance < radius) result = .intersecting;
+        }
+        return result;
+    }
+
+    /// For every plane only the 2 corners of the box which are furthest along and against its normal need to be checked
+    pub fn classify_aabb(self: Frustum, min: Vector3f, max: Vector3f) Containment {
+        var result = Containment.inside;
+        inline for (@typeInfo(Frustum).Struct.fields) |field| {
+            const plane: Plane = @field(self, field.name);
+            const furthest_inside = Vector3f {
+                .x = if (plane.a >= 0) max.x else min.x,
+                .y = if (plane.b >= 0) max.y else min.y,
+                .z = if (plane.c >= 0) max.z else min.z,
+            };
+            if (plane.signed_distance_to_point(furthest_inside) < 0) return .outside;
+            const furthest_outside = Vector3f {
+                .x = if (plane.a >= 0) min.x else max.x,
+                .y = if (plane.b >= 0) min.y else max.y,
+                .z = if (plane.c >= 0) min.z else max.z,
+            };
+            if (plane.signed_distance_to_point(furthest_outside) < 0) result = .intersecting;
+        }
+        return result;
+    }
+};
+
+/// The bounds of a mesh in its own model space, used to cull it (or skip its clipping) as a whole
+pub const BoundingVolume = union(enum) {
+    sphere: struct { center: Vector3f, radius: f32 },
+    aabb: struct { min: Vector3f, max: Vector3f },
+
+    /// `frustum` must be in the same space as the bounds, which is what `Plane.extract_frustum_from_projection` gives when passed the model-view-projection matrix
+    pub fn classify(self: BoundingVolume, frustum: Frustum) Frustum.Containment {
+        return switch (self) {
+            .sphere => |sphere| frustum.classify_sphere(sphere.center, sphere.radius),
+            .aabb => |aabb| frustum.classify_aabb(aabb.min, aabb.max),
+        };
+    }
 };
 
 /// Check Appendix A for more info:
@@ -808,10 +901,11 @@ pub const Plane = struct {
         frustum.bottom.c = projection_matrix.data[11] + projection_matrix.data[9];
         frustum.bottom.d = projection_matrix.data[15] + projection_matrix.data[13];
         // Near clipping plane
-        frustum.near.a = projection_matrix.data[3] + projection_matrix.data[2];
-        frustum.near.b = projection_matrix.data[7] + projection_matrix.data[6];
-        frustum.near.c = projection_matrix.data[11] + projection_matrix.data[10];
-        frustum.near.d = projection_matrix.data[15] + projection_matrix.data[14];
+        // NOTE the projections in here map z to [0, 1] rather than [-1, 1] (the paper calls it the direct3d convention) so the near plane is just `z >= 0`
+        frustum.near.a = projection_matrix.data[2];
+        frustum.near.b = projection_matrix.data[6];
+        frustum.near.c = projection_matrix.data[10];
+        frustum.near.d = projection_matrix.data[14];
         // Far clipping plane
         frustum.far.a = projection_matrix.data[3] - projection_matrix.data[2];
         frustum.far.b = projection_matrix.data[7] - projection_matrix.data[6];
@@ -227,3 +227,207 @@ pub const BGRA = extern struct {
         return from(RGBA, RGBA.from_hex(color));
     }
 };
+
+/// An index into a palette, for render targets which are turned into colors with `resolve_indexed` right before presenting.
+/// Blending an `Indexed` pixel either replaces the destination or, if it is `transparent`, discards it
+pub const Indexed = extern struct {
+    index: u8,
+    comptime { std.debug.assert(@sizeOf(@This()) == 1); }
+    pub const transparent = Indexed { .index = 255 };
+    pub inline fn make(index: u8) Indexed {
+        return Indexed { .index = index };
+    }
+};
+
+/// Writes `palette[index]` for every pixel of `source` into `destination`. Indices out of the palette become `palette[0]`.
+/// Palettes of up to 16 colors of 4 bytes are looked up 16 pixels at a time, selecting every color of the palette in turn
+pub fn resolve_indexed(comptime T: type, palette: []const T, source: []const Indexed, destination: []T) void {
+    std.debug.assert(source.len == destination.len);
+    std.debug.assert(palette.len > 0);
+    var i: usize = 0;
+    if (@sizeOf(T) == 4) {
+        const lanes = 16;
+        const Colors = @Vector(lanes, u32);
+        while (palette.len <= 16 and i + lanes <= source.len) : (i += lanes) {
+            const indices: @Vector(lanes, u8) = @as(*const [lanes]u8, @ptrCast(source[i..][0..lanes])).*;
+            var colors: Colors = @splat(@as(u32, @bitCast(palette[0])));
+            for (palette[1..], 1..) |color, palette_index| {
+                colors = @select(u32, indices == @as(@Vector(lanes, u8), @splat(@intCast(palette_index))), @as(Colors, @splat(@as(u32, @bitCast(color)))), colors);
+            }
+            destination[i..][0..lanes].* = @bitCast(@as([lanes]u32, colors));
+        }
+    }
+    for (source[i..], destination[i..]) |pixel, *color| {
+        color.* = if (pixel.index < palette.len) palette[pixel.index] else palette[0];
+    }
+}
+
+/// How a pipeline writes a shaded pixel (the source) over the one already in the pixel buffer (the destination).
+/// Pixel types without an alpha channel are treated as fully opaque sources.
+pub const BlendMode = enum {
+    /// the source replaces the destination
+    @"opaque",
+    /// `src * src.a + dst * (1 - src.a)`, same as the `blend` of the pixel types
+    alpha,
+    /// the source color is already multiplied by its alpha: `src + dst * (1 - src.a)`
+    premultiplied,
+    /// `dst + src * src.a`, saturated
+    additive,
+    /// `src * dst`
+    multiply,
+};
+
+/// Blends a span of `source` pixels into `destination`, 4 pixels at a time as a `@Vector(16, u16)`, dividing by 255 exactly with integer math.
+/// Works with any pixel type made of 3 or 4 `u8` channels.
+pub fn blend_span(comptime T: type, comptime mode: BlendMode, source: []const T, destination: []T) void {
+    std.debug.assert(source.len == destination.len);
+    if (mode == .@"opaque") {
+        @memcpy(destination, source);
+        return;
+    }
+    if (T == Indexed) {
+        for (source, destination) |source_pixel, *destination_pixel| destination_pixel.* = blend_pixel(T, mode, source_pixel, destination_pixel.*);
+        return;
+    }
+    var i: usize = 0;
+    while (i + 4 <= source.len) : (i += 4) {
+        const blended = blend_lanes(T, mode, 4, to_lanes(T, 4, source[i..][0..4]), to_lanes(T, 4, destination[i..][0..4]));
+        from_lanes(T, 4, blended, destination[i..][0..4]);
+    }
+    for (source[i..], destination[i..]) |source_pixel, *destination_pixel| {
+        destination_pixel.* = blend_pixel(T, mode, source_pixel, destination_pixel.*);
+    }
+}
+
+/// Same as `blend_span` with every source pixel being `color`. An opaque fill is a `@memset`, otherwise the lanes of
+/// the source are only built once
+pub fn fill_span(comptime T: type, comptime mode: BlendMode, color: T, destination: []T) void {
+    if (T == Indexed) {
+        if (mode == .@"opaque" or blend_pixel(T, mode, color, Indexed.transparent).index != Indexed.transparent.index) @memset(destination, color);
+        return;
+    }
+    const source = to_lanes(T, 4, &[4]T { color, color, color, color });
+    const alpha = source[alpha_lane(T)];
+    const replaces = switch (mode) {
+        .@"opaque" => true,
+        .alpha, .premultiplied => alpha == 255,
+        .additive, .multiply => false,
+    };
+    if (replaces) {
+        @memset(destination, color);
+        return;
+    }
+    if (alpha == 0 and (mode == .alpha or mode == .additive)) return;
+    var i: usize = 0;
+    while (i + 4 <= destination.len) : (i += 4) {
+        from_lanes(T, 4, blend_lanes(T, mode, 4, source, to_lanes(T, 4, destination[i..][0..4])), destination[i..][0..4]);
+    }
+    for (destination[i..]) |*destination_pixel| {
+        destination_pixel.* = blend_pixel(T, mode, color, destination_pixel.*);
+    }
+}
+
+/// Single pixel version of `blend_span`
+pub inline fn blend_pixel(comptime T: type, comptime mode: BlendMode, source: T, destination: T) T {
+    if (mode == .@"opaque") return source;
+    if (T == Indexed) {
+        if (mode != .alpha and mode != .premultiplied) @compileError("Indexed pixels can only be blended with `alpha` or `premultiplied`, which discard the transparent index");
+        return if (source.index == Indexed.transparent.index) destination else source;
+    }
+    var result: [1]T = undefined;
+    from_lanes(T, 1, blend_lanes(T, mode, 1, to_lanes(T, 1, &[1]T { source }), to_lanes(T, 1, &[1]T { destination })), &result);
+    return result[0];
+}
+
+/// Every pixel takes 4 lanes, one per channel in declaration order. Pixel types without alpha get a 4th lane of 255 which is used as their alpha
+fn alpha_lane(comptime T: type) usize {
+    const fields = @typeInfo(T).Struct.fields;
+    if (fields.len != 3 and fields.len != 4) @compileError("blending needs a pixel type of 3 or 4 u8 channels, not " ++ @typeName(T));
+    inline for (fields) |field| if (field.type != u8) @compileError("blending needs a pixel type of 3 or 4 u8 channels, not " ++ @typeName(T));
+    if (fields.len == 3) return 3;
+    inline for (fields, 0..) |field, i| if (std.mem.eql(u8, field.name, "a")) return i;
+    @compileError("blending needs the 4th channel of " ++ @typeName(T) ++ " to be called `a`");
+}
+
+inline fn to_lanes(comptime T: type, comptime n: usize, pixels: *const [n]T) @Vector(n * 4, u16) {
+    var lanes: [n * 4]u16 = .{255} ** (n * 4);
+    inline for (0..n) |p| {
+        inline for (@typeInfo(T).Struct.fields, 0..) |field, c| lanes[p * 4 + c] = @field(pixels[p], field.name);
+    }
+    return lanes;
+}
+
+inline fn from_lanes(comptime T: type, comptime n: usize, lanes: @Vector(n * 4, u16), pixels: *[n]T) void {
+    const lanes_array: [n * 4]u16 = lanes;
+    inline for (0..n) |p| {
+        inline for (@typeInfo(T).Struct.fields, 0..) |field, c| @field(pixels[p], field.name) = @intCast(lanes_array[p * 4 + c]);
+    }
+}
+
+/// `round(x / 255)` for any `x` in [0, 255*255]
+inline fn div_255(comptime n: usize, x: @Vector(n, u16)) @Vector(n, u16) {
+    const t = x + @as(@Vector(n, u16), @splat(128));
+    return (t + (t >> @splat(8))) >> @splat(8);
+}
+
+inline fn blend_lanes(comptime T: type, comptime mode: BlendMode, comptime n: usize, source: @Vector(n * 4, u16), destination: @Vector(n * 4, u16)) @Vector(n * 4, u16) {
+    const V = @Vector(n * 4, u16);
+    const alpha_mask = comptime blk: {
+        var mask: [n * 4]i32 = undefined;
+        for (0..n) |p| {
+            for (0..4) |c| mask[p * 4 + c] = p * 4 + alpha_lane(T);
+        }
+        break :blk mask;
+    };
+    const alpha = @shuffle(u16, source, undefined, alpha_mask);
+    const max: V = @splat(255);
+    return switch (mode) {
+        .@"opaque" => source,
+        .alpha => div_255(n * 4, source * alpha + destination * (max - alpha)),
+        .premultiplied => @min(max, source + div_255(n * 4, destination * (max - alpha))),
+        .additive => @min(max, destination + div_255(n * 4, source * alpha)),
+        .multiply => div_255(n * 4, source * destination),
+    };
+}
+
+test "integer blending matches the float blend" {
+    const source = [5]RGBA { RGBA.make(255, 0, 0, 128), RGBA.make(10, 20, 30, 0), RGBA.make(10, 20, 30, 255), RGBA.make(200, 100, 50, 64), RGBA.make(0, 255, 0, 200) };
+    const background = RGBA.make(0, 0, 255, 255);
+    var destination = [_]RGBA { background } ** 5;
+    blend_span(RGBA, .alpha, &source, &destination);
+    for (source, destination) |source_pixel, blended| {
+        const expected = source_pixel.blend(background);
+        // the float version truncates while the integer one rounds
+        try std.testing.expect(@abs(@as(i16, expected.r) - blended.r) <= 1);
+        try std.testing.expect(@abs(@as(i16, expected.g) - blended.g) <= 1);
+        try std.testing.expect(@abs(@as(i16, expected.b) - blended.b) <= 1);
+    }
+    try std.testing.expectEqual(background, destination[1]);
+    try std.testing.expectEqual(source[2], destination[2]);
+    try std.testing.expectEqual(RGBA.make(255, 255, 255, 255), blend_pixel(RGBA, .additive, RGBA.make(255, 255, 255, 255), background));
+    try std.testing.expectEqual(RGBA.make(0, 0, 128, 255), blend_pixel(RGBA, .multiply, RGBA.make(128, 128, 128, 255), background));
+}
+
+test "fill_span matches blend_span with a constant source" {
+    const color = RGBA.make(200, 100, 50, 64);
+    var expected = [_]RGBA { RGBA.make(0, 0, 255, 255) } ** 7;
+    var filled = expected;
+    blend_span(RGBA, .alpha, &([_]RGBA { color } ** 7), &expected);
+    fill_span(RGBA, .alpha, color, &filled);
+    try std.testing.expectEqualSlices(RGBA, &expected, &filled);
+    fill_span(RGBA, .alpha, RGBA.make(1, 2, 3, 255), &filled);
+    try std.testing.expectEqual(RGBA.make(1, 2, 3, 255), filled[6]);
+}
+
+test "resolve_indexed looks up the palette" {
+    const palette = [3]RGBA { RGBA.make(0, 0, 0, 255), RGBA.make(255, 0, 0, 255), RGBA.make(0, 255, 0, 255) };
+    var source: [19]Indexed = undefined;
+    for (&source, 0..) |*pixel, i| pixel.* = Indexed.make(@intCast(i % 4));
+    var destination: [19]RGBA = undefined;
+    resolve_indexed(RGBA, &palette, &source, &destination);
+    for (source, destination) |pixel, color| try std.testing.expectEqual(if (pixel.index < 3) palette[pixel.index] else palette[0], color);
+
+    var target = [_]Indexed { Indexed.make(1) } ** 3;
+    blend_span(Indexed, .alpha, &[3]Indexed { Indexed.make(2), Indexed.transparent, Indexed.make(0) }, &target);
+    try std.testing.expectEqualSlices(Indexed, &[3]Indexed { Indexed.make(2), Indexed.make(1), Indexed.make(0) }, &target);
+}
@@ -14,10 +14,22 @@ const GraphicsPipeline = graphics.GraphicsPipeline;
 
 // TODO force `output_pixel_type` to have `fn from(texture_pixel_type) output_pixel_type`
 pub fn Shader(comptime output_pixel_type: type, comptime texture_pixel_type: type) type {
+    return ShaderWithTextureStorage(output_pixel_type, texture_pixel_type, Buffer2D(texture_pixel_type));
+}
+
+/// Same as `Shader`, but the texture is sampled from the level of a `MipChain` that matches how big each triangle is on screen
+pub fn MipMappedShader(comptime output_pixel_type: type, comptime texture_pixel_type: type) type {
+    return ShaderWithTextureStorage(output_pixel_type, texture_pixel_type, buffer.MipChain(texture_pixel_type));
+}
+
+/// Same as `Shader`, but the texture can be any type with the `point_sample` of a `Buffer2D`, such as a `TiledBuffer2D`, or a `MipChain`
+pub fn ShaderWithTextureStorage(comptime output_pixel_type: type, comptime texture_pixel_type: type, comptime Texture: type) type {
     return struct {
 
+        const uses_mip_chain = Texture == buffer.MipChain(texture_pixel_type);
+
         pub const Context = struct {
-            texture: Buffer2D(texture_pixel_type),
+            texture: Texture,
             texture_width: usize,
             texture_height: usize,
             view_model_matrix: M44,
@@ -28,6 +40,8 @@ pub fn Shader(comptime output_pixel_type: type, comptime texture_pixel_type: typ
         pub const Invariant = struct {
             texture_uv: Vector2f,
             light_intensity: f32,
+            /// written by the pipeline when sampling a `MipChain`, see `texture_level_of_detail`
+            uv_per_pixel: f32,
         };
 
         pub const Vertex = struct {
@@ -44,26 +58,179 @@ pub fn Shader(comptime output_pixel_type: type, comptime texture_pixel_type: typ
             .do_perspective_correct_interpolation = true,
             .do_scissoring = false,
             .use_triangle_2 = false,
+            .texture_level_of_detail = if (uses_mip_chain) .{ .uv_field = "texture_uv", .uv_per_pixel_field = "uv_per_pixel" } else null,
         };
 
+        fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector4f {
+            const position_camera_space = context.view_model_matrix.apply_to_vec3(vertex.pos);
+            const light_direction = context.light_position_camera_space.substract(position_camera_space.perspective_division()).normalized();
+            out_invariant.light_intensity = std.math.clamp(vertex.normal.normalized().dot(light_direction), 0, 1);
+            out_invariant.texture_uv = vertex.uv;
+            out_invariant.uv_per_pixel = 0;
+            return context.projection_matrix.apply_to_vec4(position_camera_space);
+        }
+
         pub const Pipeline = GraphicsPipeline(
             output_pixel_type, Context, Invariant, Vertex, pipeline_configuration,
-            struct {
-                fn vertex_shader(context: Context, vertex: Vertex, out_invariant: *Invariant) Vector4f {
-                    const position_camera_space = context.view_model_matrix.apply_to_vec3(vertex.pos);
-                    const light_direction = context.light_position_camera_space.substract(position_camera_space.perspective_division()).normalized();
-                    out_invariant.light_intensity = std.math.clamp(vertex.normal.normalized().dot(light_direction), 0, 1);
-                    out_invariant.texture_uv = vertex.uv;
-                    return context.projection_matrix.apply_to_vec4(position_camera_space);
-                }
-            }.vertex_shader,
+            vertex_shader,
             struct {
                 fn fragment_shader(context: Context, invariants: Invariant) output_pixel_type {
-                    const sample = context.texture.point_sample(true, invariants.texture_uv);
+                    const sample = if (uses_mip_chain) context.texture.sample(.point, invariants.texture_uv, invariants.uv_per_pixel)
+                        else context.texture.point_sample(true, invariants.texture_uv);
                     const rgba = sample.scale(invariants.light_intensity);
                     return output_pixel_type.from(texture_pixel_type, rgba);
                 }
             }.fragment_shader,
         );
+
+        /// The vertex buffer as a structure of arrays (one array per component), which is what `transform_vertices` works on
+        pub const VertexBufferSoA = struct {
+            data: []f32,
+            pos_x: []f32,
+            pos_y: []f32,
+            pos_z: []f32,
+            u: []f32,
+            v: []f32,
+            normal_x: []f32,
+            normal_y: []f32,
+            normal_z: []f32,
+
+            pub fn init(allocator: std.mem.Allocator, vertex_buffer: []const Vertex) !VertexBufferSoA {
+                const count = vertex_buffer.len;
+                const data = try allocator.alloc(f32, count * 8);
+                const self = VertexBufferSoA {
+                    .data = data,
+                    .pos_x = data[count * 0 .. count * 1],
+                    .pos_y = data[count * 1 .. count * 2],
+                    .pos_z = data[count * 2 .. count * 3],
+                    .u = data[count * 3 .. count * 4],
+                    .v = data[count * 4 .. count * 5],
+                    .normal_x = data[count * 5 .. count * 6],
+                    .normal_y = data[count * 6 .. count * 7],
+                    .normal_z = data[count * 7 .. count * 8],
+                };
+                for (vertex_buffer, 0..) |vertex, i| self.set(i, vertex);
+                return self;
+            }
+
+            pub fn deinit(self: VertexBufferSoA, allocator: std.mem.Allocator) void {
+                allocator.free(self.data);
+            }
+
+            pub fn set(self: VertexBufferSoA, i: usize, vertex: Vertex) void {
+                self.pos_x[i] = vertex.pos.x;
+                self.pos_y[i] = vertex.pos.y;
+                self.pos_z[i] = vertex.pos.z;
+                self.u[i] = vertex.uv.x;
+                self.v[i] = vertex.uv.y;
+                self.normal_x[i] = vertex.normal.x;
+                self.normal_y[i] = vertex.normal.y;
+                self.normal_z[i] = vertex.normal.z;
+            }
+
+            pub fn get(self: VertexBufferSoA, i: usize) Vertex {
+                return .{
+                    .pos = Vector3f.from(self.pos_x[i], self.pos_y[i], self.pos_z[i]),
+                    .uv = Vector2f.from(self.u[i], self.v[i]),
+                    .normal = Vector3f.from(self.normal_x[i], self.normal_y[i], self.normal_z[i]),
+                };
+            }
+        };
+
+        /// Same as the vertex shader of `Pipeline`, but transforms and lights 8 vertices at a time. Whatever doesn't fit in a batch of 8 at the end
+        /// goes through the regular vertex shader. Draw the result with `Pipeline.render_transformed`
+        pub fn transform_vertices(context: Context, vertices: VertexBufferSoA, out_transformed_vertices: []Pipeline.TransformedVertex) void {
+            const lanes = 8;
+            const V = @Vector(lanes, f32);
+            const count = vertices.pos_x.len;
+            std.debug.assert(out_transformed_vertices.len >= count);
+
+            const light_position = math.Vector3fx8 {
+                .x = @splat(context.light_position_camera_space.x),
+                .y = @splat(context.light_position_camera_space.y),
+                .z = @splat(context.light_position_camera_space.z),
+            };
+            const zero: V = @splat(0);
+            const one: V = @splat(1);
+
+            var i: usize = 0;
+            while (i + lanes <= count) : (i += lanes) {
+                const position = math.Vector3fx8 { .x = vertices.pos_x[i..][0..lanes].*, .y = vertices.pos_y[i..][0..lanes].*, .z = vertices.pos_z[i..][0..lanes].* };
+                const normal = math.Vector3fx8 { .x = vertices.normal_x[i..][0..lanes].*, .y = vertices.normal_y[i..][0..lanes].*, .z = vertices.normal_z[i..][0..lanes].* };
+                const position_camera_space = context.view_model_matrix.apply_to_vec3_x8(position);
+                const light_direction = normalized_x8(light_position.substract(position_camera_space.perspective_division()));
+                // same as `std.math.clamp` in `vertex_shader`
+                const light_intensity = @max(zero, @min(normalized_x8(normal).dot(light_direction), one));
+                const clip_space_position = context.projection_matrix.apply_to_vec4_x8(position_camera_space);
+
+                const x: [lanes]f32 = clip_space_position.x;
+                const y: [lanes]f32 = clip_space_position.y;
+                const z: [lanes]f32 = clip_space_position.z;
+                const w: [lanes]f32 = clip_space_position.w;
+                const intensity: [lanes]f32 = light_intensity;
+                for (0..lanes) |lane| {
+                    out_transformed_vertices[i + lane] = .{
+                        .clip_space_position = Vector4f.from(x[lane], y[lane], z[lane], w[lane]),
+                        .invariants = .{
+                            .texture_uv = Vector2f.from(vertices.u[i + lane], vertices.v[i + lane]),
+                            .light_intensity = intensity[lane],
+                            .uv_per_pixel = 0,
+                        },
+                    };
+                }
+            }
+            while (i < count) : (i += 1) {
+                const transformed_vertex = &out_transformed_vertices[i];
+                transformed_vertex.clip_space_position = vertex_shader(context, vertices.get(i), &transformed_vertex.invariants);
+            }
+        }
+
+        /// `Vec3.normalized` for 8 vectors at once, dividing every component by the magnitude just like the scalar version does
+        fn normalized_x8(v: math.Vector3fx8) math.Vector3fx8 {
+            const magnitude = @sqrt(v.dot(v));
+            return math.Vector3fx8.from(v.x / magnitude, v.y / magnitude, v.z / magnitude);
+        }
     };
 }
+
+test "transform_vertices lights and transforms every vertex like the vertex shader" {
+    const pixels = @import("../pixels.zig");
+    const Gouraud = Shader(pixels.RGBA, pixels.RGB);
+    // 11 vertices, so that both a batch of 8 and the 3 left over are transformed
+    var vertex_buffer: [11]Gouraud.Vertex = undefined;
+    for (&vertex_buffer, 0..) |*vertex, i| {
+        const f: f32 = @floatFromInt(i);
+        vertex.* = .{
+            .pos = Vector3f.from(f * 0.3 - 1.5, @sin(f), f * 0.1 - 0.5),
+            .uv = Vector2f.from(f / 11, 1 - f / 11),
+            .normal = Vector3f.from(@cos(f), 1 - f * 0.2, @sin(f * 0.7) * 3),
+        };
+    }
+    const vertices = try Gouraud.VertexBufferSoA.init(std.testing.allocator, &vertex_buffer);
+    defer vertices.deinit(std.testing.allocator);
+
+    var texture_data = [_]pixels.RGB { pixels.RGB.from(255, 255, 255) };
+    const context = Gouraud.Context {
+        .texture = Buffer2D(pixels.RGB).from(&texture_data, 1),
+        .texture_width = 1,
+        .texture_height = 1,
+        .view_model_matrix = M44.translation(Vector3f.from(0.2, -0.1, -4)),
+        .projection_matrix = M44.perspective_projection(60, 4.0 / 3.0, 0.1, 100),
+        .light_position_camera_space = Vector3f.from(2, 3, 1),
+    };
+    var transformed_vertices: [11]Gouraud.Pipeline.TransformedVertex = undefined;
+    Gouraud.transform_vertices(context, vertices, &transformed_vertices);
+
+    const tolerance = 1e-5;
+    for (vertex_buffer, transformed_vertices) |vertex, transformed_vertex| {
+        var invariants: Gouraud.Invariant = undefined;
+        const clip_space_position = Gouraud.vertex_shader(context, vertex, &invariants);
+        try std.testing.expectApproxEqAbs(clip_space_position.x, transformed_vertex.clip_space_position.x, tolerance);
+        try std.testing.expectApproxEqAbs(clip_space_position.y, transformed_vertex.clip_space_position.y, tolerance);
+        try std.testing.expectApproxEqAbs(clip_space_position.z, transformed_vertex.clip_space_position.z, tolerance);
+        try std.testing.expectApproxEqAbs(clip_space_position.w, transformed_vertex.clip_space_position.w, tolerance);
+        try std.testing.expectEqual(invariants.texture_uv, transformed_vertex.invariants.texture_uv);
+        try std.testing.expectApproxEqAbs(invariants.light_intensity, transformed_vertex.invariants.light_intensity, tolerance);
+        try std.testing.expectEqual(invariants.uv_per_pixel, transformed_vertex.invariants.uv_per_pixel);
+    }
+}
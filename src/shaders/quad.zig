@@ -15,10 +15,15 @@ const GraphicsPipeline = graphics.GraphicsPipeline;
 const RGBA = @import("../pixels.zig").RGBA;
 
 pub fn Shader(comptime output_pixel_type: type, comptime texture_pixel_type: type, comptime use_bilinear: bool, comptime config_interface_text: bool) type {
+    return ShaderWithTextureStorage(output_pixel_type, texture_pixel_type, Buffer2D(texture_pixel_type), use_bilinear, config_interface_text);
+}
+
+/// Same as `Shader`, but the texture can be any type with the `point_sample` and `bilinear_sample_fixed_point` of a `Buffer2D`, such as a `TiledBuffer2D`
+pub fn ShaderWithTextureStorage(comptime output_pixel_type: type, comptime texture_pixel_type: type, comptime Texture: type, comptime use_bilinear: bool, comptime config_interface_text: bool) type {
     return struct {
 
         pub const Context = struct {
-            texture: Buffer2D(texture_pixel_type),
+            texture: Texture,
             projection_matrix: M44,
         };
 
@@ -65,7 +70,7 @@ pub fn Shader(comptime output_pixel_type: type, comptime texture_pixel_type: typ
             }.vertex_shader,
             struct {
                 fn fragment_shader(context: Context, invariants: Invariant) output_pixel_type {
-                    const sample = if (use_bilinear) context.texture.bilinear_sample(!config_interface_text, invariants.texture_uv) else context.texture.point_sample(!config_interface_text, invariants.texture_uv);
+                    const sample = if (use_bilinear) context.texture.bilinear_sample_fixed_point(!config_interface_text, invariants.texture_uv) else context.texture.point_sample(!config_interface_text, invariants.texture_uv);
                     return output_pixel_type.from(texture_pixel_type, sample);
                 }
             }.fragment_shader,
@@ -0,0 +1,162 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const Buffer2D = @import("buffer.zig").Buffer2D;
+
+pub const Filter = enum {
+    /// every source pixel becomes a `factor` x `factor` block
+    nearest,
+    /// bilinear filtering between the centers of the source pixels, clamped at the edges.
+    /// Only supported for 4 byte pixel types.
+    smooth,
+};
+
+pub const Options = struct {
+    filter: Filter = .nearest,
+    /// When set, the source rows are split into `bands` jobs that run on the pool, and the calling thread helps out until they are done.
+    /// Ignored on single threaded targets such as wasm.
+    thread_pool: ?*std.Thread.Pool = null,
+    bands: usize = 8,
+};
+
+const supports_threads = !builtin.single_threaded and !builtin.cpu.arch.isWasm();
+
+/// Scales `src` by an integer `factor` (1 to 8) into the bottom left corner of `dst`, which has to be at least `factor` times as big.
+/// 4 byte pixels are written with `@Vector` stores, so the SIMD instructions used depend on the target.
+pub fn upscale(comptime T: type, src: Buffer2D(T), dst: Buffer2D(T), comptime factor: usize, options: Options) void {
+    comptime std.debug.assert(factor >= 1 and factor <= 8);
+    std.debug.assert(dst.width >= src.width * factor and dst.height >= src.height * factor);
+    if (options.filter == .smooth) std.debug.assert(@sizeOf(T) == 4);
+
+    const Band = struct {
+        fn run(band_src: Buffer2D(T), band_dst: Buffer2D(T), filter: Filter, first_row: usize, end_row: usize) void {
+            switch (filter) {
+                .nearest => nearest_rows(T, band_src, band_dst, factor, first_row, end_row),
+                .smooth => if (@sizeOf(T) == 4) smooth_rows(T, band_src, band_dst, factor, first_row, end_row) else unreachable,
+            }
+        }
+        fn run_job(band_src: Buffer2D(T), band_dst: Buffer2D(T), filter: Filter, first_row: usize, end_row: usize, wait_group: *std.Thread.WaitGroup) void {
+            defer wait_group.finish();
+            run(band_src, band_dst, filter, first_row, end_row);
+        }
+    };
+
+    const thread_pool: ?*std.Thread.Pool = if (supports_threads) options.thread_pool else null;
+    const band_count = @max(1, @min(options.bands, src.height));
+    if (thread_pool == null or band_count == 1) return Band.run(src, dst, options.filter, 0, src.height);
+
+    // every band of source rows writes to its own band of destination rows, so they dont need any synchronization
+    const rows_per_band = std.math.divCeil(usize, src.height, band_count) catch unreachable;
+    var wait_group = std.Thread.WaitGroup {};
+    var first_row: usize = 0;
+    while (first_row < src.height) : (first_row += rows_per_band) {
+        const end_row = @min(first_row + rows_per_band, src.height);
+        wait_group.start();
+        // if the job cant be queued just do it right here
+        thread_pool.?.spawn(Band.run_job, .{ src, dst, options.filter, first_row, end_row, &wait_group }) catch Band.run_job(src, dst, options.filter, first_row, end_row, &wait_group);
+    }
+    thread_pool.?.waitAndWork(&wait_group);
+}
+
+fn nearest_rows(comptime T: type, src: Buffer2D(T), dst: Buffer2D(T), comptime factor: usize, first_row: usize, end_row: usize) void {
+    const dst_row_width = src.width * factor;
+    for (first_row..end_row) |src_y| {
+        const src_row = src.data[src_y * src.width ..][0..src.width];
+        const dst_row = dst.data[src_y * factor * dst.width ..][0..dst_row_width];
+        if (@sizeOf(T) == 4) {
+            for (src_row, 0..) |pixel, i| {
+                const block: @Vector(factor, u32) = @splat(@as(u32, @bitCast(pixel)));
+                dst_row[i * factor ..][0..factor].* = @bitCast(@as([factor]u32, block));
+            }
+        } else {
+            for (src_row, 0..) |pixel, i| @memset(dst_row[i * factor ..][0..factor], pixel);
+        }
+        // the rest of the rows in the block are identical to the first one
+        for (1..factor) |i| @memcpy(dst.data[(src_y * factor + i) * dst.width ..][0..dst_row_width], dst_row);
+    }
+}
+
+/// The source pixel to the left (or below) and the weight of the next one, out of 256, for every pixel in a block of `factor` pixels.
+const Phase = struct { offset: isize, weight: u32 };
+fn phases(comptime factor: usize) [factor]Phase {
+    const f: isize = @intCast(factor);
+    var result: [factor]Phase = undefined;
+    for (&result, 0..) |*phase, p| {
+        // distance from the center of the source pixel to the center of the destination pixel, in units of 1/(2*factor) source pixels
+        const n: isize = 2 * @as(isize, @intCast(p)) + 1 - f;
+        const offset = @divFloor(n, 2 * f);
+        phase.* = .{ .offset = offset, .weight = @intCast(@divFloor((n - offset * 2 * f) * 256, 2 * f)) };
+    }
+    return result;
+}
+
+const Channels = @Vector(4, u32);
+
+inline fn channels(pixel: anytype) Channels {
+    return @intCast(@as(@Vector(4, u8), @bitCast(pixel)));
+}
+
+inline fn lerp(a: Channels, b: Channels, weight: u32) Channels {
+    const w: Channels = @splat(weight);
+    return (a * (@as(Channels, @splat(256)) - w) + b * w + @as(Channels, @splat(128))) / @as(Channels, @splat(256));
+}
+
+inline fn clamp_index(i: isize, len: usize) usize {
+    return @intCast(std.math.clamp(i, 0, @as(isize, @intCast(len)) - 1));
+}
+
+fn smooth_rows(comptime T: type, src: Buffer2D(T), dst: Buffer2D(T), comptime factor: usize, first_row: usize, end_row: usize) void {
+    const table = comptime phases(factor);
+    for (first_row..end_row) |src_y| {
+        inline for (table, 0..) |phase_y, py| {
+            const bottom_y = clamp_index(@as(isize, @intCast(src_y)) + phase_y.offset, src.height);
+            const top_y = clamp_index(@as(isize, @intCast(src_y)) + phase_y.offset + 1, src.height);
+            const bottom_row = src.data[bottom_y * src.width ..][0..src.width];
+            const top_row = src.data[top_y * src.width ..][0..src.width];
+            const dst_row = dst.data[(src_y * factor + py) * dst.width ..][0 .. src.width * factor];
+            for (0..src.width) |src_x| {
+                inline for (table, 0..) |phase_x, px| {
+                    const left = clamp_index(@as(isize, @intCast(src_x)) + phase_x.offset, src.width);
+                    const right = clamp_index(@as(isize, @intCast(src_x)) + phase_x.offset + 1, src.width);
+                    const bottom = lerp(channels(bottom_row[left]), channels(bottom_row[right]), phase_x.weight);
+                    const top = lerp(channels(top_row[left]), channels(top_row[right]), phase_x.weight);
+                    const result: @Vector(4, u8) = @intCast(lerp(bottom, top, phase_y.weight));
+                    dst_row[src_x * factor + px] = @bitCast(result);
+                }
+            }
+        }
+    }
+}
+
+test "nearest upscale repeats every pixel in a block" {
+    const RGBA = @import("pixels.zig").RGBA;
+    var src_data = [_]RGBA{ RGBA.make(1, 2, 3, 4), RGBA.make(5, 6, 7, 8), RGBA.make(9, 10, 11, 12), RGBA.make(13, 14, 15, 16) };
+    var dst_data: [6 * 6]RGBA = undefined;
+    const src = Buffer2D(RGBA).from(&src_data, 2);
+    const dst = Buffer2D(RGBA).from(&dst_data, 6);
+    var thread_pool: std.Thread.Pool = undefined;
+    try thread_pool.init(.{ .allocator = std.testing.allocator, .n_jobs = 2 });
+    defer thread_pool.deinit();
+    for ([_]?*std.Thread.Pool { null, &thread_pool }) |pool| {
+        @memset(&dst_data, RGBA.make(0, 0, 0, 0));
+        upscale(RGBA, src, dst, 3, .{ .thread_pool = pool, .bands = 2 });
+        for (0..6) |y| {
+            for (0..6) |x| try std.testing.expectEqual(src.get(x / 3, y / 3), dst.get(x, y));
+        }
+    }
+}
+
+test "smooth upscale keeps flat areas and interpolates between pixels" {
+    const RGBA = @import("pixels.zig").RGBA;
+    var src_data = [_]RGBA{ RGBA.make(0, 0, 0, 255), RGBA.make(255, 255, 255, 255) };
+    var dst_data: [4 * 2]RGBA = undefined;
+    const src = Buffer2D(RGBA).from(&src_data, 2);
+    const dst = Buffer2D(RGBA).from(&dst_data, 4);
+    upscale(RGBA, src, dst, 2, .{ .filter = .smooth });
+    for (0..2) |y| {
+        // the outer pixels are clamped to the edge, the inner ones are a quarter of the way to the neighbour
+        try std.testing.expectEqual(RGBA.make(0, 0, 0, 255), dst.get(0, y));
+        try std.testing.expectEqual(RGBA.make(64, 64, 64, 255), dst.get(1, y));
+        try std.testing.expectEqual(RGBA.make(191, 191, 191, 255), dst.get(2, y));
+        try std.testing.expectEqual(RGBA.make(255, 255, 255, 255), dst.get(3, y));
+    }
+}